@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2023 Hanno Hildenbrandt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HAHI_AFFINITY_HPP_INCLUDED
+#define HAHI_AFFINITY_HPP_INCLUDED
+#pragma once
+
+// CPUs available to the process and thread placement.
+//
+// Linux: cpuset from sched_getaffinity, CPU quota from cgroup v2 (cpu.max) or
+// v1 (cpu.cfs_quota_us), NUMA nodes from /sys/devices/system/cpu.
+// elsewhere: std::thread::hardware_concurrency() CPUs on one node, no pinning.
+
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+#ifdef __linux__
+# include <sched.h>
+#endif
+
+
+namespace hahi::affinity {
+
+  struct cpu_t {
+    unsigned id;
+    unsigned node;    // NUMA node
+  };
+
+
+  // NUMA node of cpu, 0 if unknown
+  inline unsigned numa_node(unsigned cpu) {
+#ifdef __linux__
+    auto ec = std::error_code{};
+    const auto dir = std::filesystem::path("/sys/devices/system/cpu") / ("cpu" + std::to_string(cpu));
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+      const auto name = entry.path().filename().string();
+      if (name.starts_with("node")) {
+        try { return static_cast<unsigned>(std::stoul(name.substr(4))); } catch (...) {}
+      }
+    }
+#endif
+    (void)cpu;
+    return 0;
+  }
+
+
+  // CPUs the process may run on, ordered by NUMA node, then id
+  inline std::vector<cpu_t> allowed_cpus() {
+    auto cpus = std::vector<cpu_t>{};
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (0 == ::sched_getaffinity(0, sizeof(set), &set)) {
+      for (unsigned i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &set)) cpus.push_back({ i, numa_node(i) });
+      }
+    }
+#endif
+    if (cpus.empty()) {
+      for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); ++i) cpus.push_back({ i, 0 });
+    }
+    std::stable_sort(cpus.begin(), cpus.end(), [](const auto& a, const auto& b) { return a.node < b.node; });
+    return cpus;
+  }
+
+
+  // CPU quota of the cgroup, rounded up. 0: no quota
+  inline unsigned cgroup_cpus() {
+#ifdef __linux__
+    auto quota = [](double q, double period) { return (q > 0 && period > 0) ? static_cast<unsigned>((q + period - 1) / period) : 0u; };
+    if (auto is = std::ifstream("/sys/fs/cgroup/cpu.max")) {
+      // v2: "<quota|max> <period>"
+      std::string q;
+      double period = 0;
+      if ((is >> q >> period) && (q != "max")) {
+        try { return quota(std::stod(q), period); } catch (...) {}
+      }
+      return 0;
+    }
+    auto q = std::ifstream("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    auto p = std::ifstream("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    double qv = -1, pv = 0;
+    if ((q >> qv) && (p >> pv)) return quota(qv, pv);    // v1: quota -1 if unlimited
+#endif
+    return 0;
+  }
+
+
+  // number of threads the process can run in parallel:
+  // min(cpuset, cgroup quota), at least 1
+  inline unsigned concurrency() {
+    const auto cpus = static_cast<unsigned>(allowed_cpus().size());
+    const auto quota = cgroup_cpus();
+    return std::max(1u, quota ? std::min(cpus, quota) : cpus);
+  }
+
+
+  // pins the calling thread to cpu, returns false on failure or if not supported
+  inline bool pin_this_thread(unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return 0 == ::sched_setaffinity(0, sizeof(set), &set);    // 0: calling thread
+#else
+    (void)cpu;
+    return false;
+#endif
+  }
+
+}
+
+#endif // HAHI_AFFINITY_HPP_INCLUDED
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023 Hanno Hildenbrandt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HAHI_BUDGET_HPP_INCLUDED
+#define HAHI_BUDGET_HPP_INCLUDED
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+
+namespace hahi {
+
+
+  // A process-wide byte budget.
+  //
+  // sources:   acquire(n, bypass) blocks while the budget is exhausted.
+  //            bypass() is re-evaluated on release() and notify(), it shall
+  //            return true if waiting could dead-lock the pipeline.
+  // sinks:     charge(n) never blocks, may exceed the limit.
+  // all:       release(n) returns bytes to the budget.
+  // limit == 0: unlimited, bookkeeping only.
+  class budget_t
+  {
+  public:
+    explicit budget_t(size_t limit = 0) : limit_(limit) {}
+
+    size_t limit() const noexcept { return limit_; }
+    size_t used() const noexcept { return used_.load(std::memory_order_relaxed); }
+    size_t peak() const noexcept { return peak_.load(std::memory_order_relaxed); }
+
+    // accumulated time sources were blocked in acquire() or wait()
+    std::chrono::nanoseconds acquire_wait() const noexcept { return std::chrono::nanoseconds(wait_.load(std::memory_order_relaxed)); }
+
+    template <typename Pred>
+    void acquire(size_t n, Pred&& bypass) {
+      if (limit_ && n) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        timed_wait(lock, [&]() { return (used() + n <= limit_) || bypass(); });
+      }
+      charge(n);
+    }
+
+    // blocks while the budget is exhausted, acquires nothing
+    template <typename Pred>
+    void wait(Pred&& bypass) {
+      if (limit_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        timed_wait(lock, [&]() { return (used() < limit_) || bypass(); });
+      }
+    }
+
+    void charge(size_t n) noexcept {
+      const auto used = used_.fetch_add(n, std::memory_order_relaxed) + n;
+      auto peak = peak_.load(std::memory_order_relaxed);
+      while ((used > peak) && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed)) ;
+    }
+
+    void release(size_t n) noexcept {
+      used_.fetch_sub(n, std::memory_order_relaxed);
+      if (limit_) notify();
+    }
+
+    // re-evaluates bypass predicates of blocked sources
+    void notify() const noexcept {
+      { std::lock_guard<std::mutex> _(mutex_); }    // no lost wake-ups
+      cv_.notify_all();
+    }
+
+  private:
+    template <typename Pred>
+    void timed_wait(std::unique_lock<std::mutex>& lock, Pred&& pred) {
+      if (pred()) return;
+      const auto t0 = std::chrono::steady_clock::now();
+      cv_.wait(lock, pred);
+      wait_.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+    }
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    std::atomic<size_t> used_ = 0;
+    std::atomic<size_t> peak_ = 0;
+    std::atomic<int64_t> wait_ = 0;   // ns
+    const size_t limit_;
+  };
+
+}
+
+#endif // HAHI_BUDGET_HPP_INCLUDED
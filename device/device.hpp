@@ -34,6 +34,8 @@
 #include <semaphore>
 #include "mutex.hpp"    // spin_mutex
 #include "queue.hpp"
+#include "trace.hpp"
+#include "affinity.hpp"
 #include <functional>
 #if !__cpp_lib_move_only_function 
 # if __has_include(<function2/function2.hpp>)
@@ -110,12 +112,15 @@ namespace hahi {
 
 
   // models a single-threaded thread-pool
+  // cpu >= 0: thread pinned to cpu
   class device_t {
     using queue_t = concurrent_queue<detail::task_function>;
 
   public:
-    explicit device_t(unsigned max_pending) : queue_{max_pending} {
-      thread_ = std::jthread([&](std::stop_token stoken) {
+    explicit device_t(unsigned max_pending, int cpu = -1) : queue_{max_pending} {
+      thread_ = std::jthread([&, cpu](std::stop_token stoken) {
+        HAHI_TRACE_THREAD("device");
+        if (cpu >= 0) (void)affinity::pin_this_thread(static_cast<unsigned>(cpu));
         do {
           std::invoke(queue_.template pop<typename queue_t::explicit_release>());
           queue_.release();   // signal work completion
@@ -30,6 +30,8 @@
 #include <memory>
 #include <algorithm>     // std::clamp
 #include <bitset>
+#include <atomic>
+#include <chrono>
 #include "device.hpp"
 
 
@@ -45,10 +47,12 @@ namespace hahi {
     // arbitrary limit in multiplies of 64
     static constexpr unsigned max_threads = 256;
 
-    // creates pool with num_threads clamped to a hardware concurrency
-    explicit pool_t(unsigned num_threads = -1) 
-    : sem_{std::clamp(num_threads, 1u, std::thread::hardware_concurrency())} {
-      num_threads = std::clamp(num_threads, 1u, std::thread::hardware_concurrency());
+    // creates pool with num_threads clamped to the available concurrency
+    // (cpuset and cgroup quota, see affinity.hpp).
+    // pin: device i pinned to the i-th allowed cpu, filling NUMA nodes one by one.
+    explicit pool_t(unsigned num_threads = -1, bool pin = false) 
+    : sem_{std::clamp(num_threads, 1u, affinity::concurrency())} {
+      num_threads = std::clamp(num_threads, 1u, affinity::concurrency());
       if (num_threads > max_threads) {
         throw std::runtime_error("Number of threads exceeds implementation limit");
       }
@@ -56,18 +60,30 @@ namespace hahi {
       auto f64 = num_threads;
       for (; f64 >= 64; f64 -= 64, ++fit) *fit = -1;
       if (f64) *fit = (1ull << f64) - 1;
+      const auto cpus = affinity::allowed_cpus();
       for (unsigned i = 0; i < num_threads; ++i) {
-        devices_.emplace_back(new device_t{1 + 1});   // 1 work + 1 release task
+        const auto& cpu = cpus[i % cpus.size()];
+        devices_.emplace_back(new device_t{1 + 1, pin ? int(cpu.id) : -1});   // 1 work + 1 release task
+        if (pin) nodes_.push_back(cpu.node);
       }
     }
 
     unsigned num_threads() const noexcept { return devices_.size(); }
 
+    bool pinned() const noexcept { return !nodes_.empty(); }
+
+    // NUMA nodes spanned by pinned devices, 0 if not pinned
+    unsigned num_nodes() const {
+      auto nodes = nodes_;
+      std::sort(nodes.begin(), nodes.end());
+      return static_cast<unsigned>(std::unique(nodes.begin(), nodes.end()) - nodes.begin());
+    }
+
     // returns number of available jobs
     int avail() const noexcept { 
       std::lock_guard<std::mutex> _{mutex_};
       int bits = 0;
-      for (size_t i = 0; i < sizeof(free_list_); ++i) {
+      for (size_t i = 0; i < std::size(free_list_); ++i) {
         bits += std::popcount(free_list_[i]);
       }
       return bits; 
@@ -76,11 +92,19 @@ namespace hahi {
     // returns number of running jobs
     int busy() const noexcept { return num_threads() - avail(); }
 
+    // accumulated time callers were blocked in async() (all devices busy)
+    std::chrono::nanoseconds async_wait() const noexcept { return std::chrono::nanoseconds(async_wait_.load(std::memory_order_relaxed)); }
+
     // submits job to pool.
     // returns std::future
     template <typename Fun, typename... Args>
     auto async(Fun&& fun, Args&&...args) const {
-      sem_.acquire();   // wait for idle devices
+      if (!sem_.try_acquire()) {
+        // wait for idle devices
+        const auto t0 = std::chrono::steady_clock::now();
+        sem_.acquire();
+        async_wait_.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+      }
       int f64 = 0;
       int bit = 0;
       {
@@ -89,8 +113,9 @@ namespace hahi {
         bit = std::countr_zero(free_list_[f64]);
         free_list_[f64] &= ~(1ull << bit);
       }
-      auto future = devices_[bit]->enqueue(std::forward<Fun>(fun), std::forward<Args>(args)...);
-      devices_[bit]->enqueue_detach([&, bit = bit, f64 = f64]() noexcept { 
+      auto& device = devices_[64 * f64 + bit];
+      auto future = device->enqueue(std::forward<Fun>(fun), std::forward<Args>(args)...);
+      device->enqueue_detach([&, bit = bit, f64 = f64]() noexcept { 
         std::lock_guard<std::mutex> _(mutex_);
         free_list_[f64] |= (1ull << bit);
         sem_.release(1);
@@ -101,8 +126,10 @@ namespace hahi {
   private:
     mutable std::counting_semaphore<> sem_;
     mutable std::mutex mutex_;
-    mutable uint64_t free_list_[max_threads >> 6];    // bitset
+    mutable uint64_t free_list_[max_threads >> 6] = {};    // bitset
+    mutable std::atomic<int64_t> async_wait_ = 0;     // ns
     std::vector<std::unique_ptr<device_t>> devices_;
+    std::vector<unsigned> nodes_;   // NUMA node per device, pinned only
   };
 
 }
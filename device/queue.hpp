@@ -26,6 +26,8 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <semaphore>
 #include <optional>
 #include <memory>
@@ -55,6 +57,18 @@ namespace hahi {
 
     size_t max_size() const noexcept { return max_size_; }
 
+    // returns number of queued items
+    size_t size() const noexcept {
+      std::lock_guard<Mutex> _(mutex_);
+      return back_ - front_;
+    }
+
+    // accumulated time producers were blocked in push() (queue full)
+    std::chrono::nanoseconds push_wait() const noexcept { return std::chrono::nanoseconds(push_wait_.load(std::memory_order_relaxed)); }
+
+    // accumulated time consumers were blocked in get()/pop() (queue empty)
+    std::chrono::nanoseconds pop_wait() const noexcept { return std::chrono::nanoseconds(pop_wait_.load(std::memory_order_relaxed)); }
+
     template <typename... Args>
     void emplace(Args&&... args) const {
       // syntactic sugar - performing move-assignment
@@ -62,7 +76,7 @@ namespace hahi {
     }
 
     void push(value_type&& val) const {
-      in_sem_.acquire();    // wait if queue is full
+      timed_acquire(in_sem_, push_wait_);    // wait if queue is full
       {
         std::lock_guard<Mutex> _(mutex_);
         auto back = back_++ % max_size_;
@@ -88,7 +102,7 @@ namespace hahi {
     // ReleasePolicy == explicit_release: user must call releases()
     template <typename ReleasePolicy = implicit_release>
     void get(value_type& val) const {
-      out_sem_.acquire();   // wait for items;
+      timed_acquire(out_sem_, pop_wait_);   // wait for items;
       val = dequeue<ReleasePolicy>();
     }
 
@@ -96,7 +110,7 @@ namespace hahi {
     // ReleasePolicy == explicit_release: user must call releases()
     template <typename ReleasePolicy = implicit_release>
     value_type pop() const {
-      out_sem_.acquire();   // wait for items;
+      timed_acquire(out_sem_, pop_wait_);   // wait for items;
       return dequeue<ReleasePolicy>();
     }
 
@@ -120,6 +134,14 @@ namespace hahi {
     bool try_acquire() const noexcept { return in_sem_.try_acquire(); }
 
   private:
+    // clock is only read if we are going to block
+    static void timed_acquire(std::counting_semaphore<>& sem, std::atomic<int64_t>& wait) {
+      if (sem.try_acquire()) return;
+      const auto t0 = std::chrono::steady_clock::now();
+      sem.acquire();
+      wait.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+    }
+
     template <typename ReleasePolicy>
     T dequeue() const {
       std::unique_lock<Mutex> lock(mutex_);
@@ -138,6 +160,8 @@ namespace hahi {
     mutable size_t front_ = 0;
     mutable size_t back_ = 0;
     mutable std::unique_ptr<T[]> queue_;
+    mutable std::atomic<int64_t> push_wait_ = 0;   // ns
+    mutable std::atomic<int64_t> pop_wait_ = 0;    // ns
     const size_t max_size_;
   };
 
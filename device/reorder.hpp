@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2023 Hanno Hildenbrandt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HAHI_REORDER_HPP_INCLUDED
+#define HAHI_REORDER_HPP_INCLUDED
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <optional>
+#include <memory>
+
+
+namespace hahi {
+
+
+  // A fixed-size reorder buffer (ordered completion queue).
+  //
+  // producer: seq = acquire(), blocks while the window is full.
+  // workers:  put(seq, value) in any order, never blocks.
+  // consumer: pop() returns values in sequence order, wakes up as soon
+  //           as the next in-order value is available.
+  //           returns empty optional after close() and all values are consumed.
+  template <typename T>
+  class reorder_buffer
+  {
+  public:
+    using value_type = T;
+
+    explicit reorder_buffer(size_t max_size)
+    : slots_(new slot_t[max_size]),
+      max_size_(max_size)
+    {}
+
+    size_t max_size() const noexcept { return max_size_; }
+
+    // returns number of acquired but not yet consumed slots
+    size_t size() const noexcept {
+      std::lock_guard<std::mutex> _(mutex_);
+      return tail_ - head_;
+    }
+
+    // returns next sequence number
+    // blocks while the window is full
+    size_t acquire() const {
+      std::unique_lock<std::mutex> lock(mutex_);
+      in_cv_.wait(lock, [&]() { return (tail_ - head_) < max_size_; });
+      return tail_++;
+    }
+
+    void put(size_t seq, value_type&& val) const {
+      std::lock_guard<std::mutex> _(mutex_);
+      auto& slot = slots_[seq % max_size_];
+      slot.val.emplace(std::move(val));
+      if (seq == head_) out_cv_.notify_one();
+    }
+
+    // rethrown by pop()
+    void put_exception(size_t seq, std::exception_ptr eptr) const {
+      std::lock_guard<std::mutex> _(mutex_);
+      slots_[seq % max_size_].eptr = eptr;
+      if (seq == head_) out_cv_.notify_one();
+    }
+
+    // no more acquire() calls
+    void close() const {
+      std::lock_guard<std::mutex> _(mutex_);
+      closed_ = true;
+      out_cv_.notify_one();
+    }
+
+    // returns values in sequence order
+    // blocks until the next value is available
+    std::optional<value_type> pop() const {
+      std::unique_lock<std::mutex> lock(mutex_);
+      out_cv_.wait(lock, [&]() {
+        const auto& slot = slots_[head_ % max_size_];
+        return (head_ < tail_) ? (slot.val.has_value() || slot.eptr) : closed_;
+      });
+      if (head_ == tail_) return {};  // closed
+      auto& slot = slots_[head_++ % max_size_];
+      auto val = std::exchange(slot.val, std::nullopt);
+      auto eptr = std::exchange(slot.eptr, nullptr);
+      lock.unlock();
+      in_cv_.notify_one();
+      if (eptr) std::rethrow_exception(eptr);
+      return val;
+    }
+
+  private:
+    struct slot_t {
+      std::optional<value_type> val;
+      std::exception_ptr eptr;
+    };
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable in_cv_;
+    mutable std::condition_variable out_cv_;
+    mutable size_t head_ = 0;   // next to pop
+    mutable size_t tail_ = 0;   // next to acquire
+    mutable bool closed_ = false;
+    mutable std::unique_ptr<slot_t[]> slots_;
+    const size_t max_size_;
+  };
+
+}
+
+#endif // HAHI_REORDER_HPP_INCLUDED
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2023 Hanno Hildenbrandt
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef HAHI_TRACE_HPP_INCLUDED
+#define HAHI_TRACE_HPP_INCLUDED
+#pragma once
+
+// Chrome trace (chrome://tracing, ui.perfetto.dev) of scoped events.
+//
+// compiled in with -DHAHI_TRACE only, otherwise HAHI_TRACE_SCOPE and
+// HAHI_TRACE_THREAD expand to nothing.
+// recording starts with hahi::trace::enable().
+//
+// events go into per-thread, append-only buffers (single writer, no locks),
+// the buffers outlive their threads. dump() is safe while threads are recording
+// but shall be called after the interesting part is done.
+
+#ifdef HAHI_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+
+
+namespace hahi::trace {
+
+  using clock_t = std::chrono::steady_clock;
+
+  struct event_t {
+    const char* name;     // static string
+    int64_t ts;           // ns since epoch()
+    int64_t dur;          // ns
+  };
+
+
+  namespace detail {
+
+    inline std::atomic<bool> enabled = false;
+
+    // JSON string literal, names may hold file paths
+    struct quoted {
+      std::string_view str;
+
+      friend std::ostream& operator<<(std::ostream& os, const quoted& q) {
+        constexpr char hex[] = "0123456789abcdef";
+        os << '"';
+        for (const char c : q.str) {
+          if ((c == '"') || (c == '\\')) os << '\\' << c;
+          else if (static_cast<unsigned char>(c) < 0x20) os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+          else os << c;
+        }
+        return os << '"';
+      }
+    };
+
+    inline const clock_t::time_point epoch = clock_t::now();
+
+    // linked list of fixed-size blocks, single producer
+    class buffer_t {
+      static constexpr size_t block_size = 4096;
+
+      struct block_t {
+        event_t events[block_size];
+        std::atomic<size_t> size = 0;
+        std::atomic<block_t*> next = nullptr;
+      };
+
+    public:
+      explicit buffer_t(int tid) : tid(tid), head_(new block_t), tail_(head_) {}
+
+      ~buffer_t() {
+        for (auto* blk = head_; blk;) delete std::exchange(blk, blk->next.load());
+      }
+
+      // owning thread only
+      void push(const event_t& e) {
+        auto n = tail_->size.load(std::memory_order_relaxed);
+        if (n == block_size) {
+          auto* blk = new block_t;
+          tail_->next.store(blk, std::memory_order_release);
+          tail_ = blk;
+          n = 0;
+        }
+        tail_->events[n] = e;
+        tail_->size.store(n + 1, std::memory_order_release);
+      }
+
+      // any thread
+      template <typename Fun>
+      void for_each(Fun&& fun) const {
+        for (const auto* blk = head_; blk; blk = blk->next.load(std::memory_order_acquire)) {
+          const auto n = blk->size.load(std::memory_order_acquire);
+          for (size_t i = 0; i < n; ++i) fun(blk->events[i]);
+        }
+      }
+
+      const int tid;
+      std::string name;   // set before first event
+
+    private:
+      block_t* const head_;
+      block_t* tail_;
+    };
+
+
+    struct registry_t {
+      std::mutex mutex;
+      std::vector<std::shared_ptr<buffer_t>> buffers;
+    };
+
+    inline registry_t& registry() {
+      static registry_t reg;
+      return reg;
+    }
+
+    inline buffer_t& local_buffer() {
+      thread_local std::shared_ptr<buffer_t> buf = []() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> _(reg.mutex);
+        return reg.buffers.emplace_back(std::make_shared<buffer_t>(static_cast<int>(reg.buffers.size())));
+      }();
+      return *buf;
+    }
+
+  }
+
+
+  inline void enable(bool on = true) noexcept { detail::enabled.store(on, std::memory_order_relaxed); }
+  inline bool enabled() noexcept { return detail::enabled.load(std::memory_order_relaxed); }
+
+
+  // names the calling thread in the trace
+  inline void thread_name(std::string name) {
+    if (enabled()) detail::local_buffer().name = std::move(name);
+  }
+
+
+  // records [construction, destruction)
+  class scope_t {
+  public:
+    explicit scope_t(const char* name) noexcept : name_(name) {
+      if (enabled()) t0_ = clock_t::now();
+    }
+
+    ~scope_t() {
+      if (t0_ != clock_t::time_point{}) {
+        const auto t1 = clock_t::now();
+        detail::local_buffer().push({ name_, (t0_ - detail::epoch).count(), (t1 - t0_).count() });
+      }
+    }
+
+  private:
+    const char* name_;
+    clock_t::time_point t0_{};
+  };
+
+
+  // writes Chrome trace event format (JSON object format)
+  inline void dump(std::ostream& os) {
+    auto& reg = detail::registry();
+    std::lock_guard<std::mutex> _(reg.mutex);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() -> std::ostream& { return os << (std::exchange(first, false) ? "" : ",\n"); };
+    for (const auto& buf : reg.buffers) {
+      if (!buf->name.empty()) {
+        sep() << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buf->tid << R"(,"args":{"name":)" << detail::quoted{ buf->name } << "}}";
+      }
+      buf->for_each([&](const event_t& e) {
+        // microseconds
+        sep() << R"({"name":)" << detail::quoted{ e.name } << R"(,"ph":"X","pid":1,"tid":)" << buf->tid
+              << ",\"ts\":" << e.ts / 1000 << '.' << (e.ts % 1000) / 100
+              << ",\"dur\":" << e.dur / 1000 << '.' << (e.dur % 1000) / 100 << '}';
+      });
+    }
+    os << "\n]}\n";
+  }
+
+}
+
+#define HAHI_TRACE_CAT_(a, b) a##b
+#define HAHI_TRACE_CAT(a, b) HAHI_TRACE_CAT_(a, b)
+#define HAHI_TRACE_SCOPE(name) hahi::trace::scope_t HAHI_TRACE_CAT(hahi_trace_scope_, __LINE__){name}
+#define HAHI_TRACE_THREAD(name) hahi::trace::thread_name(name)
+
+#else
+
+#define HAHI_TRACE_SCOPE(name) ((void)0)
+#define HAHI_TRACE_THREAD(name) ((void)0)
+
+#endif
+
+#endif // HAHI_TRACE_HPP_INCLUDED
@@ -0,0 +1,124 @@
+/* fastq/bam.hpp
+ *
+ * Copyright (c) 2025 Hanno Hildenbrandt <h.hildenbrandt@rug.nl>
+ */
+
+/*
+ * unaligned BAM records, see SAM/BAM specification
+ * https://samtools.github.io/hts-specs/SAMv1.pdf, section 4.2
+ *
+ * renders uncompressed BAM into std::string, to be compressed
+ * by writer_t in bgzf mode.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <array>
+#include <span>
+#include <initializer_list>
+#include "fastq.hpp"
+
+
+namespace fastq::bam {
+
+  // flags of unmapped pairs
+  enum flag : uint16_t {
+    paired = 0x1,
+    unmapped = 0x4,
+    mate_unmapped = 0x8,
+    read1 = 0x40,
+    read2 = 0x80,
+  };
+
+  constexpr uint16_t flag_r1 = paired | unmapped | mate_unmapped | read1;   // 77
+  constexpr uint16_t flag_r2 = paired | unmapped | mate_unmapped | read2;   // 141
+
+
+  namespace detail {
+
+    template <typename T>
+    inline void put(std::string& out, T val) {
+      // little endian
+      for (size_t i = 0; i < sizeof(T); ++i, val = T(uint64_t(val) >> 8)) out.push_back(char(uint64_t(val) & 0xff));
+    }
+
+    // "=ACMGRSVTWYHKDBN" 4-bit codes
+    constexpr std::array<uint8_t, 256> nt16 = []() {
+      auto t = std::array<uint8_t, 256>{};
+      t.fill(15);   // N
+      constexpr char codes[] = "=ACMGRSVTWYHKDBN";
+      for (uint8_t i = 0; i < 16; ++i) {
+        t[uint8_t(codes[i])] = i;
+        if (codes[i] >= 'A' && codes[i] <= 'Z') t[uint8_t(codes[i] - 'A' + 'a')] = i;
+      }
+      return t;
+    }();
+
+  }
+
+
+  // BAM header of unaligned BAM (no references)
+  inline std::string header(str_view text) {
+    auto out = std::string{"BAM\1"};
+    detail::put<int32_t>(out, static_cast<int32_t>(text.length()));
+    out.append(text);
+    detail::put<int32_t>(out, 0);    // n_ref
+    return out;
+  }
+
+
+  // Z-type aux field, value concatenated from parts
+  struct tag_t {
+    char tag[2];
+    std::span<const str_view> parts;
+  };
+
+
+  // appends unmapped record
+  // name: without leading '@', qual: phred + 33
+  inline void append_record(std::string& out, str_view name, uint16_t flag, str_view seq, str_view qual, std::initializer_list<tag_t> tags) {
+    const auto l_seq = seq.length();
+    size_t aux = 0;
+    for (const auto& t : tags) {
+      aux += 4;   // tag, type, NUL
+      for (auto p : t.parts) aux += p.length();
+    }
+    const auto block_size = 32 + (name.length() + 1) + (l_seq + 1) / 2 + l_seq + aux;
+    out.reserve(out.size() + 4 + block_size);
+    detail::put<int32_t>(out, static_cast<int32_t>(block_size));
+    detail::put<int32_t>(out, -1);      // refID
+    detail::put<int32_t>(out, -1);      // pos
+    detail::put<uint8_t>(out, static_cast<uint8_t>(name.length() + 1));
+    detail::put<uint8_t>(out, 0);       // mapq
+    detail::put<uint16_t>(out, 4680);   // bin, reg2bin(-1, 0)
+    detail::put<uint16_t>(out, 0);      // n_cigar_op
+    detail::put<uint16_t>(out, flag);
+    detail::put<int32_t>(out, static_cast<int32_t>(l_seq));
+    detail::put<int32_t>(out, -1);      // next_refID
+    detail::put<int32_t>(out, -1);      // next_pos
+    detail::put<int32_t>(out, 0);       // tlen
+    out.append(name);
+    out.push_back('\0');
+    for (size_t i = 0; i < l_seq; i += 2) {
+      const uint8_t hi = detail::nt16[uint8_t(seq[i])];
+      const uint8_t lo = (i + 1 < l_seq) ? detail::nt16[uint8_t(seq[i + 1])] : 0;
+      out.push_back(char((hi << 4) | lo));
+    }
+    if (qual.length() == l_seq) {
+      for (char q : qual) out.push_back(char(q - 33));
+    }
+    else {
+      out.append(l_seq, char(0xff));
+    }
+    for (const auto& t : tags) {
+      out.push_back(t.tag[0]);
+      out.push_back(t.tag[1]);
+      out.push_back('Z');
+      for (auto p : t.parts) out.append(p);
+      out.push_back('\0');
+    }
+  }
+
+}
@@ -6,12 +6,14 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <stdexcept>
 #include <fstream>
 #include <filesystem>
 #include <string>
 #include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 #include "fastq.hpp"
 #include "splitter.hpp"
@@ -20,10 +22,52 @@
 namespace fastq {
 
 
+  // 2-bit nucleotide code, -1 for anything else (N)
+  constexpr int base_code(char chr) noexcept {
+    switch (chr) {
+      case 'A': return 0;
+      case 'C': return 1;
+      case 'G': return 2;
+      case 'T': return 3;
+      default: return -1;
+    }
+  }
+
+
+  // pairwise distance structure of a barcode set
+  // see analyse_barcode() in fuzzy_matching.hpp
+  struct correctability_t {
+    int min_ed = -1;            // min. pairwise edit distance, -1 if not analysed
+    size_t min_ed_pairs = 0;    // number of pairs at min_ed
+    size_t duplicates = 0;      // number of pairs with ed == 0
+    size_t collisions = 0;      // number of codes within ed 2 of another code (radius 1 ambiguous)
+
+    // guaranteed correction radius
+    int radius() const noexcept { return (min_ed > 0) ? (min_ed - 1) / 2 : 0; }
+  };
+
+
+  // first-stage matcher in front of the full edit-distance scan
+  enum class Matcher {
+    scan,       // full scan (+ positional index if available)
+    exact,      // exact table, full scan (+ positional index if available)
+    radius1,    // exact table, radius-1 neighbourhood hash, full scan
+  };
+
+
+  inline const char* matcher_name(Matcher m) noexcept {
+    constexpr const char* names[] = { "scan", "exact", "radius1" };
+    return names[static_cast<int>(m)];
+  }
+
+
   // barcode file reader
   // more general: <tag, code> file reader
   class barcode_t {
   public:
+    static constexpr size_t max_exact_length = 12;   // 4^12 entries direct-address table
+    static constexpr size_t max_radius1_length = 30;  // packed key + length fits in 64 bit
+
     struct entry_t {
       std::string tag;
       std::string code;
@@ -60,6 +104,9 @@ namespace fastq {
           unclear_tag[0] = bc_[1].tag[0];
         }
         bc_[0].tag = unclear_tag;
+        build_pos_index();
+        build_exact_table();
+        select_matcher(correctability_);
       }
       catch (const std::exception& err) {
         throw std::runtime_error(path.string() + ": " + err.what());
@@ -79,6 +126,9 @@ namespace fastq {
         std::sort(bc_.begin() + 1, bc_.end(), [](const auto& a, const auto& b) {
           return a.tag < b.tag;
         });
+        build_pos_index();
+        build_exact_table();
+        select_matcher(correctability_);
       }
     }
 
@@ -98,8 +148,141 @@ namespace fastq {
     //const std::string& unclear_tag() const noexcept { return unclear_tag_; }
     const std::filesystem::path& path() const noexcept { return path_; }
 
+    // bit-sliced positional index, only available if all codes share the same length.
+    // bit (i - 1) in pos_mask(pos, base) is set if code i has 'base' at 'pos'.
+    bool has_pos_index() const noexcept { return !pos_index_.empty(); }
+    size_t pos_index_words() const noexcept { return words_; }
+    const uint64_t* pos_mask(size_t pos, int base) const noexcept { 
+      return pos_index_.data() + (4 * pos + base) * words_;
+    }
+
+    // mask of used bits in word w
+    uint64_t pos_valid(size_t w) const noexcept {
+      const size_t tail = (bc_.size() - 1) & 63;
+      return ((w + 1 < words_) || (tail == 0)) ? ~uint64_t(0) : (uint64_t(1) << tail) - 1;
+    }
+
+    const correctability_t& correctability() const noexcept { return correctability_; }
+    Matcher matcher() const noexcept { return matcher_; }
+
+    // picks the fastest safe matcher given the analysis of this set:
+    // radius1 requires disjoint radius-1 balls (min_ed >= 3), so any hit is the unique
+    // min_ed == 1 code. exact requires short codes.
+    void select_matcher(const correctability_t& ca) {
+      correctability_ = ca;
+      radius1_.clear();
+      matcher_ = exact_.empty() ? Matcher::scan : Matcher::exact;
+      if ((ca.min_ed >= 3) && (max_code_length_ <= max_radius1_length) && (matcher_ == Matcher::exact)) {
+        for (size_t i = 1; i < bc_.size(); ++i) {
+          if (bc_[i].code.find_first_not_of("ACGT") != std::string::npos) {
+            radius1_.clear();
+            return;
+          }
+          auto var = bc_[i].code;
+          for (size_t pos = 0; pos <= var.length(); ++pos) {
+            for (const char chr : { 'A', 'C', 'G', 'T' }) {
+              // insertion
+              var.insert(pos, 1, chr);
+              radius1_.emplace(radius1_key(var), static_cast<int>(i));
+              var.erase(pos, 1);
+              // substitution
+              if ((pos < var.length()) && (var[pos] != chr)) {
+                const char org = std::exchange(var[pos], chr);
+                radius1_.emplace(radius1_key(var), static_cast<int>(i));
+                var[pos] = org;
+              }
+            }
+            // deletion
+            if (pos < var.length()) {
+              const char org = var[pos];
+              var.erase(pos, 1);
+              radius1_.emplace(radius1_key(var), static_cast<int>(i));
+              var.insert(pos, 1, org);
+            }
+          }
+        }
+        matcher_ = Matcher::radius1;
+      }
+    }
+
+    // radius-1 neighbourhood lookup, returns the index of the unique code
+    // with ed(seq, code) == 1 or 0.
+    // only meaningful after exact_match(seq) failed.
+    int radius1_match(str_view seq) const noexcept {
+      if ((matcher_ != Matcher::radius1) || (seq.length() > max_radius1_length + 1)) return 0;
+      const auto key = radius1_key(seq);
+      if (key == 0) return 0;
+      auto it = radius1_.find(key);
+      return (it != radius1_.end()) ? it->second : 0;
+    }
+
+    // direct-address lookup, returns the index of the first code == seq or 0.
+    // returns 0 for seq containing anything but ACGT too (slow path). 
+    int exact_match(str_view seq) const noexcept {
+      if ((seq.length() >= exact_.size()) || exact_[seq.length()].empty()) return 0;
+      size_t key = 0;
+      for (const char chr : seq) {
+        const int base = base_code(chr);
+        if (base < 0) return 0;
+        key = (key << 2) | base;
+      }
+      return exact_[seq.length()][key];
+    }
+
   private:
+    // 2-bit packed sequence with leading length marker, 0 if seq contains anything but ACGT
+    static uint64_t radius1_key(str_view seq) noexcept {
+      uint64_t key = 1;
+      for (const char chr : seq) {
+        const int base = base_code(chr);
+        if (base < 0) return 0;
+        key = (key << 2) | base;
+      }
+      return key;
+    }
+
+    void build_exact_table() {
+      exact_.clear();
+      if ((bc_.size() <= 1) || (bc_.size() > 0xFFFF) || (min_code_length_ > max_exact_length)) return;
+      exact_.resize(std::min(max_code_length_, max_exact_length) + 1);
+      for (size_t i = bc_.size() - 1; i > 0; --i) {   // reverse: first code wins
+        const auto& code = bc_[i].code;
+        if ((code.length() > max_exact_length) || (code.find_first_not_of("ACGT") != std::string::npos)) continue;
+        auto& tab = exact_[code.length()];
+        if (tab.empty()) tab.resize(size_t(1) << (2 * code.length()), 0);
+        size_t key = 0;
+        for (const char chr : code) key = (key << 2) | base_code(chr);
+        tab[key] = static_cast<uint16_t>(i);
+      }
+    }
+
+    void build_pos_index() {
+      pos_index_.clear();
+      words_ = 0;
+      if ((bc_.size() <= 1) || (min_code_length_ != max_code_length_)) return;
+      for (size_t i = 1; i < bc_.size(); ++i) {
+        // 'N' in code would match 'N' in read
+        if (bc_[i].code.find_first_not_of("ACGT") != std::string::npos) return;
+      }
+      words_ = (bc_.size() - 1 + 63) >> 6;
+      pos_index_.resize(4 * max_code_length_ * words_, 0);
+      for (size_t i = 1; i < bc_.size(); ++i) {
+        const auto& code = bc_[i].code;
+        for (size_t pos = 0; pos < code.length(); ++pos) {
+          if (const int base = base_code(code[pos]); base >= 0) {
+            pos_index_[(4 * pos + base) * words_ + ((i - 1) >> 6)] |= uint64_t(1) << ((i - 1) & 63);
+          }
+        }
+      }
+    }
+
     std::vector<entry_t> bc_;
+    std::vector<uint64_t> pos_index_;   // [pos][base][word]
+    std::vector<std::vector<uint16_t>> exact_;   // [code length][packed code]
+    std::unordered_map<uint64_t, int> radius1_;  // radius-1 neighbourhood -> code index
+    correctability_t correctability_;
+    Matcher matcher_ = Matcher::scan;
+    size_t words_ = 0;
     size_t min_code_length_ = 1'000'000;
     size_t max_code_length_ = 0;
     std::filesystem::path path_;
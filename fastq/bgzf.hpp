@@ -0,0 +1,89 @@
+/* fastq/bgzf.hpp
+ *
+ * Copyright (c) 2025 Hanno Hildenbrandt <h.hildenbrandt@rug.nl>
+ */
+
+/*
+ * BGZF: blocked gzip format, see SAM/BAM specification
+ * https://samtools.github.io/hts-specs/SAMv1.pdf, section 4.1
+ *
+ * a BGZF file is a series of independent gzip members (blocks) of at most 64KiB,
+ * each with an extra field 'BC' holding the block size.
+ * thus, it's a valid multi-member gzip file.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include "fastq.hpp"
+
+
+namespace fastq::bgzf {
+
+  constexpr size_t max_block_size = 0x10000;    // compressed, incl. header and footer
+  constexpr size_t max_block_data = 0xff00;     // uncompressed, as htslib
+  constexpr size_t header_size = 18;
+  constexpr size_t footer_size = 8;
+
+  // empty block, end-of-file marker
+  constexpr char eof_block[] =
+    "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00"
+    "\x1b\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00";
+  constexpr size_t eof_block_size = sizeof(eof_block) - 1;
+
+
+  namespace detail {
+
+    // little endian
+    inline void store(char* dst, uint32_t val, int bytes) {
+      for (int i = 0; i < bytes; ++i, val >>= 8) dst[i] = static_cast<char>(val & 0xff);
+    }
+
+  }
+
+
+  // upper bound of compressed size of n bytes
+  constexpr size_t bound(size_t n) {
+    const size_t blocks = (n + max_block_data - 1) / max_block_data;
+    return std::max<size_t>(1, blocks) * max_block_size;
+  }
+
+
+  // compresses [src, src + n) into ceil(n / max_block_data) blocks, 
+  // n == 0 yields one empty block.
+  // strm: raw deflate stream (windowBits -15)
+  // dst shall provide bound(n) bytes.
+  // returns { compressed bytes, crc32 of [src, src + n) }
+  inline std::pair<size_t, uint32_t> compress(zng_stream& strm, const char* src, size_t n, char* dst) {
+    size_t out = 0;
+    uint32_t crc = zng_crc32(0L, nullptr, 0);
+    do {
+      const auto blk = std::min(n, max_block_data);
+      char* hdr = dst + out;
+      (void)zng_deflateReset(&strm);
+      strm.next_in = (unsigned char*)src;
+      strm.avail_in = static_cast<uint32_t>(blk);
+      strm.next_out = (unsigned char*)hdr + header_size;
+      strm.avail_out = static_cast<uint32_t>(max_block_size - header_size - footer_size);
+      if (Z_STREAM_END != zng_deflate(&strm, Z_FINISH)) {
+        throw std::runtime_error("fastq::bgzf::compress: block overflow");
+      }
+      const size_t cdata = (max_block_size - header_size - footer_size) - strm.avail_out;
+      const size_t bsize = header_size + cdata + footer_size;
+      std::memcpy(hdr, "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00", 16);
+      detail::store(hdr + 16, static_cast<uint32_t>(bsize - 1), 2);
+      const auto bcrc = static_cast<uint32_t>(zng_crc32(0L, (const unsigned char*)src, static_cast<uint32_t>(blk)));
+      detail::store(hdr + header_size + cdata, bcrc, 4);
+      detail::store(hdr + header_size + cdata + 4, static_cast<uint32_t>(blk), 4);
+      crc = static_cast<uint32_t>(zng_crc32_combine(crc, bcrc, blk));
+      out += bsize;
+      src += blk;
+      n -= blk;
+    } while (n);
+    return { out, crc };
+  }
+
+}
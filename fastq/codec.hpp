@@ -0,0 +1,242 @@
+/* fastq/codec.hpp
+ *
+ * Copyright (c) 2025 Hanno Hildenbrandt <h.hildenbrandt@rug.nl>
+ */
+
+/*
+ * output codecs of writer_t:
+ *   gzip: one gzip member, deflated in Z_SYNC_FLUSH'ed slices (pigz-style),
+ *         each primed with the preceding 32KiB
+ *   bgzf: independent <= 64KiB gzip blocks, see bgzf.hpp
+ *   zstd: one zstd frame per slice (concatenated frames form a valid .zst)
+ *   none: uncompressed, e.g. stdout or named pipes
+ *
+ * and the matching input side (infile_t) used by reader_t, which also
+ * serves preloaded, decompressed input from memory.
+*/
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <zstd.h>
+#include "fastq.hpp"
+
+
+namespace fastq {
+
+  struct codec_t {
+    enum kind_t { gzip, bgzf, zstd, none };
+
+    static constexpr int default_level = INT_MIN;   // Z_DEFAULT_COMPRESSION, ZSTD_CLEVEL_DEFAULT
+
+    kind_t kind = gzip;
+    int level = default_level;            // min. level if adaptive
+    int max_level = default_level;        // adaptive: level moves in [level, max_level]
+    int strategy = Z_DEFAULT_STRATEGY;    // deflate only
+
+    // independent frames per slice (no stream-spanning state)
+    bool framed() const noexcept { return (kind == bgzf) || (kind == zstd); }
+
+    // level follows the writer's backpressure
+    bool adaptive() const noexcept { return max_level != default_level; }
+
+    // lvl: current level of adaptive codecs
+    int deflate_level(int lvl) const noexcept { return ((lvl == default_level) || (kind == zstd)) ? Z_DEFAULT_COMPRESSION : lvl; }
+    int zstd_level(int lvl) const noexcept { return (lvl == default_level) ? ZSTD_CLEVEL_DEFAULT : lvl; }
+    int deflate_level() const noexcept { return deflate_level(level); }
+    int zstd_level() const noexcept { return zstd_level(level); }
+
+    // by file: stdout ("-") and named pipes -> none, *.zst -> zstd, gzip otherwise
+    static codec_t from_path(const std::filesystem::path& path) {
+      auto ec = std::error_code{};
+      if ((path == "-") || std::filesystem::is_fifo(path, ec)) return codec_t{ none };
+      return codec_t{ (path.extension() == ".zst") ? zstd : gzip };
+    }
+
+    // "<gzip|bgzf|zstd>[:<level>|:<min>-<max>][:<default|filtered|huffman|rle|fixed>]" or "none"
+    // ex: "gzip:1", "bgzf:6:filtered", "zstd:-3", "zstd:19", "gzip:1-6" (adaptive)
+    static codec_t parse(std::string_view spec) {
+      auto next = [&]() {
+        const auto sep = spec.find(':');
+        const auto tok = spec.substr(0, sep);
+        spec.remove_prefix((sep == spec.npos) ? spec.size() : sep + 1);
+        return tok;
+      };
+      auto codec = codec_t{};
+      const auto name = next();
+      if (name == "gzip") codec.kind = gzip;
+      else if (name == "bgzf") codec.kind = bgzf;
+      else if (name == "zstd") codec.kind = zstd;
+      else if (name == "none") codec.kind = none;
+      else throw std::runtime_error("unknown codec '" + std::string(name) + "', expected gzip, bgzf, zstd or none");
+      if ((codec.kind == none) && !spec.empty()) throw std::runtime_error("codec 'none' takes no arguments");
+      if (const auto lvl = next(); !lvl.empty()) {
+        auto parse_level = [&](std::string_view str) {
+          int val = 0;
+          auto [p, ec] = std::from_chars(str.data(), str.data() + str.size(), val);
+          if ((ec != std::errc{}) || (p != str.data() + str.size())) throw std::runtime_error("can't parse codec level");
+          const bool valid = (codec.kind == zstd) ? (val >= ZSTD_minCLevel()) && (val <= ZSTD_maxCLevel())
+                                                  : (val >= 0) && (val <= 9);
+          if (!valid) throw std::runtime_error("codec level out of range");
+          return val;
+        };
+        const auto range = lvl.find('-', 1);    // zstd: negative levels
+        codec.level = parse_level(lvl.substr(0, range));
+        if (range != lvl.npos) {
+          codec.max_level = parse_level(lvl.substr(range + 1));
+          if (codec.max_level < codec.level) throw std::runtime_error("empty codec level range");
+        }
+      }
+      if (const auto strat = next(); !strat.empty()) {
+        if (codec.kind == zstd) throw std::runtime_error("zstd codec doesn't support deflate strategies");
+        constexpr std::pair<std::string_view, int> strategies[] = {
+          { "default", Z_DEFAULT_STRATEGY }, { "filtered", Z_FILTERED }, { "huffman", Z_HUFFMAN_ONLY },
+          { "rle", Z_RLE }, { "fixed", Z_FIXED }
+        };
+        auto it = std::find_if(std::begin(strategies), std::end(strategies), [&](const auto& s) { return s.first == strat; });
+        if (it == std::end(strategies)) throw std::runtime_error("unknown deflate strategy '" + std::string(strat) + '\'');
+        codec.strategy = it->second;
+      }
+      if (!spec.empty()) throw std::runtime_error("can't parse codec");
+      return codec;
+    }
+
+    std::string str() const {
+      constexpr const char* names[] = { "gzip", "bgzf", "zstd", "none" };
+      auto s = std::string(names[kind]);
+      if (level != default_level) s += ':' + std::to_string(level);
+      if (adaptive()) s += '-' + std::to_string(max_level);
+      return s;
+    }
+  };
+
+
+  namespace zstd {
+
+    // upper bound of compressed size of n bytes
+    inline size_t bound(size_t n) { return ZSTD_compressBound(n); }
+
+
+    // compresses [src, src + n) into one frame with content size and checksum
+    // returns compressed bytes
+    inline size_t compress(ZSTD_CCtx* cctx, int level, const char* src, size_t n, char* dst, size_t capacity) {
+      (void)ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+      (void)ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+      (void)ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+      const auto ret = ZSTD_compress2(cctx, dst, capacity, src, n);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error(std::string("fastq::zstd::compress: ") + ZSTD_getErrorName(ret));
+      }
+      return ret;
+    }
+
+
+    // zstd frame magic number, little endian
+    inline bool is_zstd(const unsigned char* magic) noexcept {
+      return (magic[0] == 0x28) && (magic[1] == 0xb5) && (magic[2] == 0x2f) && (magic[3] == 0xfd);
+    }
+
+  }
+
+
+  // sequential, decompressing input
+  // zstd (by magic number) or anything zlib's gzread accepts (gzip, plain text)
+  class infile_t {
+  public:
+    infile_t() = default;
+    infile_t(infile_t&& rhs) noexcept { *this = std::move(rhs); }
+    infile_t& operator=(infile_t&& rhs) noexcept {
+      std::swap(gzin_, rhs.gzin_);
+      std::swap(zin_, rhs.zin_);
+      std::swap(dctx_, rhs.dctx_);
+      std::swap(zbuf_, rhs.zbuf_);
+      std::swap(zpos_, rhs.zpos_);
+      std::swap(zoffset_, rhs.zoffset_);
+      std::swap(zret_, rhs.zret_);
+      std::swap(mem_, rhs.mem_);
+      std::swap(mpos_, rhs.mpos_);
+      return *this;
+    }
+
+    infile_t(const std::filesystem::path& path, unsigned gz_buffer) {
+      unsigned char magic[4] = { 0 };
+      if (auto* f = std::fopen(path.string().c_str(), "rb")) {
+        const auto n = std::fread(magic, 1, 4, f);
+        std::fclose(f);
+        if ((n == 4) && zstd::is_zstd(magic)) {
+          zin_ = std::fopen(path.string().c_str(), "rb");
+          dctx_ = ZSTD_createDCtx();
+          zbuf_.resize(std::max<size_t>(gz_buffer, ZSTD_DStreamInSize()));
+          if (!zin_ || !dctx_) throw std::runtime_error("fastq::infile_t: failed to open input file \'" + path.string() + '\'');
+          return;
+        }
+      }
+      if (nullptr == (gzin_ = zng_gzopen(path.string().c_str(), "rb"))) {
+        throw std::runtime_error("fastq::infile_t: failed to open input file \'" + path.string() + '\'');
+      }
+      zng_gzbuffer(gzin_, gz_buffer);
+    }
+
+    // serves decompressed content from memory, e.g. preloaded input
+    explicit infile_t(std::shared_ptr<const std::string> mem) : mem_(std::move(mem)) {}
+
+    ~infile_t() {
+      if (gzin_) zng_gzclose(gzin_);
+      if (zin_) std::fclose(zin_);
+      if (dctx_) ZSTD_freeDCtx(dctx_);
+    }
+
+    // reads up to n decompressed bytes, less than n at eof only
+    // returns -1 on error
+    int read(char* buf, unsigned n) {
+      if (gzin_) return zng_gzread(gzin_, buf, n);
+      if (mem_) {
+        const auto avail = std::min<size_t>(n, mem_->size() - mpos_);
+        std::memcpy(buf, mem_->data() + mpos_, avail);
+        mpos_ += avail;
+        return static_cast<int>(avail);
+      }
+      auto out = ZSTD_outBuffer{ buf, n, 0 };
+      while (out.pos < out.size) {
+        if (zpos_.pos == zpos_.size) {
+          zpos_ = ZSTD_inBuffer{ zbuf_.data(), std::fread(zbuf_.data(), 1, zbuf_.size(), zin_), 0 };
+          zoffset_ += zpos_.size;
+          if (zpos_.size == 0) {
+            if (zret_ != 0) return -1;    // truncated frame
+            break;   // eof
+          }
+        }
+        zret_ = ZSTD_decompressStream(dctx_, &out, &zpos_);
+        if (ZSTD_isError(zret_)) return -1;
+      }
+      return static_cast<int>(out.pos);
+    }
+
+    // compressed bytes consumed
+    size_t offset() const noexcept {
+      if (mem_) return mpos_;
+      return gzin_ ? static_cast<size_t>(zng_gzoffset(gzin_)) : zoffset_ - (zpos_.size - zpos_.pos);
+    }
+
+  private:
+    gzFile gzin_ = nullptr;
+    FILE* zin_ = nullptr;
+    ZSTD_DCtx* dctx_ = nullptr;
+    std::vector<char> zbuf_;
+    ZSTD_inBuffer zpos_ = { nullptr, 0, 0 };
+    size_t zoffset_ = 0;
+    size_t zret_ = 0;     // 0: frame complete
+    std::shared_ptr<const std::string> mem_;
+    size_t mpos_ = 0;
+  };
+
+}
@@ -0,0 +1,368 @@
+/* fastq/demux_writer.hpp
+ *
+ * Copyright (c) 2025 Hanno Hildenbrandt <h.hildenbrandt@rug.nl>
+ */
+
+/*
+ * per-sample outputs of a demultiplexed stream.
+ *
+ * a writer_t per sample doesn't scale to thousands of samples: one thread,
+ * one open file and one queue each. a demux_writer_t merely buffers its input,
+ * flush() cuts the buffers of many writers into slices, compresses them in the
+ * shared pool and appends them to the files. a file is open while the slices
+ * of one flush are written, its position advances once they are on disk.
+ *
+ * gzip: the slices of a writer form one member, each slice primed with the
+ * preceding 32KiB while the writer holds its buffers (see writer_t).
+ * spilling releases the buffers, the next slice starts unprimed.
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <span>
+#include <future>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <device/pool.hpp>
+#include <device/budget.hpp>
+#include <device/trace.hpp>
+#include "writer.hpp"
+
+
+namespace fastq {
+
+
+  class demux_writer_t {
+  public:
+    using buffer_t = std::string;
+
+    struct geometry_t {
+      unsigned chunk_size = 64 * 1024;    // buffered input compressed by one job
+      codec_t codec = {};                 // output format, adaptive: min. level
+      std::shared_ptr<hahi::budget_t> budget = nullptr;   // optional, charged for buffered input
+    };
+
+    enum class flush_t {
+      chunk,    // full chunks, keeps the buffers
+      spill,    // all input, releases the buffers
+      sync,     // all input, finishes the gzip member
+      last      // all input, finishes the stream
+    };
+
+    // stream state of one pool job, reused by all writers
+    class compressor_t {
+    public:
+      compressor_t() { zng_stream_init(strm_, {}); }
+      ~compressor_t() {
+        (void)zng_deflateEnd(&strm_);
+        ZSTD_freeCCtx(cctx_);
+      }
+      compressor_t(const compressor_t&) = delete;
+      compressor_t& operator=(const compressor_t&) = delete;
+
+    private:
+      friend class demux_writer_t;
+
+      ZSTD_CCtx* cctx() {
+        if (!cctx_ && (nullptr == (cctx_ = ZSTD_createCCtx()))) throw std::runtime_error("fastq::demux_writer_t: not enough memory");
+        return cctx_;
+      }
+
+      char* out(size_t n) {
+        if (out_.size() < n) out_.resize(n);
+        return out_.data();
+      }
+
+      zng_stream strm_;     // raw deflate, pinned (zlib keeps a back pointer)
+      ZSTD_CCtx* cctx_ = nullptr;
+      buffer_t dict_;
+      buffer_t out_;
+    };
+
+    // append.file_bytes != -1: truncates existing output to append.file_bytes and
+    // appends a new gzip member (resume from sync()).
+    demux_writer_t(const std::filesystem::path& output, const stream_pos_t& append, const geometry_t& geo)
+    : geo_(geo),
+      output_(output)
+    {
+      if (geo_.chunk_size < 4096) throw std::runtime_error("fastq::demux_writer_t: invalid geometry");
+      if (append.file_bytes != size_t(-1)) {
+        std::filesystem::resize_file(output, append.file_bytes);
+        pos_ = append;
+      }
+      else {
+        if (!std::ofstream(output, std::ios::binary)) throw std::runtime_error(std::string("fastq::demux_writer_t: failed to open output file \'") + output.string() + '\'');
+        pos_ = { 0, 0, static_cast<uint32_t>(zng_crc32(0L, nullptr, 0)) };
+      }
+      tot_gz_bytes_ = pos_.file_bytes;
+      closed_ = false;
+    }
+
+    ~demux_writer_t() {
+      if (file_) std::fclose(file_);    // failed flush
+      if (geo_.budget) geo_.budget->release(in_.size());
+    }
+
+    const auto& path() const noexcept { return output_; }
+    const geometry_t& geometry() const noexcept { return geo_; }
+    bool closed() const noexcept { return closed_; }
+
+    // uncompressed and compressed bytes written so far
+    size_t tot_bytes() const noexcept { return tot_bytes_; }
+    size_t tot_gz_bytes() const noexcept { return tot_gz_bytes_; }
+
+    // time spent compressing, summed over pool threads
+    std::chrono::nanoseconds deflate_time() const noexcept { return deflate_time_; }
+
+    // fixed, the min. level of adaptive codecs
+    int level() const noexcept { return geo_.codec.level; }
+    double mean_level() const noexcept { return double(level()); }
+
+    // end of stream, valid after flush(last)
+    const stream_pos_t& stream_pos() const noexcept { return pos_; }
+
+    // holds buffers, see flush(spill)
+    bool open() const noexcept { return in_.capacity() || window_.capacity(); }
+
+    // chunk_size bytes buffered
+    bool full() const noexcept { return in_.size() >= geo_.chunk_size; }
+
+    // buffers str, see flush()
+    void put(str_view str) {
+      if (closed_) throw std::runtime_error("fastq::demux_writer_t: attempt to write into closed stream");
+      if (in_.capacity() < geo_.chunk_size) in_.reserve(geo_.chunk_size);
+      in_.append(str.data(), str.size());
+      if (geo_.budget) geo_.budget->charge(str.size());
+    }
+
+    // stream position at the member boundary, requires flush(sync)
+    std::future<stream_pos_t> sync() {
+      assert(in_.empty() && !member_);
+      auto promise = std::promise<stream_pos_t>{};
+      promise.set_value(pos_);
+      return promise.get_future();
+    }
+
+    // requires flush(last)
+    void close(bool = false) {
+      assert(in_.empty() && !member_);
+      closed_ = true;
+    }
+
+    // compresses the buffered input of writers in the pool and appends it to their files.
+    // rounds of up to cs.size() slices (chunk_size) are compressed in parallel and
+    // written in order by the caller. writers shall appear at most once in ws.
+    static void flush(const hahi::pool_t& pool, std::span<const std::unique_ptr<compressor_t>> cs, std::span<demux_writer_t* const> ws, flush_t mode) {
+      auto slices = std::vector<slice_t>{};
+      for (auto* w : ws) w->slice(slices, mode);
+      auto fs = std::vector<std::future<void>>{};
+      for (size_t r = 0; r < slices.size(); r += cs.size()) {
+        const auto round = std::span(slices).subspan(r, std::min(cs.size(), slices.size() - r));
+        fs.clear();
+        for (size_t i = 0; i < round.size(); ++i) {
+          fs.emplace_back(pool.async([&s = round[i], &c = *cs[i]]() { s.w->compress(c, s); }));
+        }
+        auto eptr = std::exception_ptr{};
+        for (auto& f : fs) {
+          try { f.get(); }    // running jobs reference compressors and slices
+          catch (...) { if (!eptr) eptr = std::current_exception(); }
+        }
+        if (eptr) std::rethrow_exception(eptr);
+        HAHI_TRACE_SCOPE("write");
+        for (size_t i = 0; i < round.size(); ++i) {
+          auto* w = round[i].w;
+          w->write(*cs[i], round[i]);
+          if ((r + i + 1 == slices.size()) || (slices[r + i + 1].w != w)) w->commit();   // writer's last slice
+        }
+      }
+      for (auto* w : ws) w->consume(mode);
+    }
+
+  private:
+    static constexpr size_t dict_size = 32 * 1024;   // deflate window
+
+    // part of the buffered input compressed by one job
+    struct slice_t {
+      demux_writer_t* w;
+      size_t begin;
+      size_t len;
+      bool finish;            // ends the gzip member (bgzf: end-of-file marker)
+      size_t size = 0;        // compressed
+      uint32_t crc = 0;       // of [begin, begin + len)
+      std::chrono::nanoseconds time{0};
+    };
+
+    // bgzf: whole blocks
+    size_t slice_size() const noexcept {
+      if (geo_.codec.kind != codec_t::bgzf) return geo_.chunk_size;
+      return std::max<size_t>(1, geo_.chunk_size / bgzf::max_block_data) * bgzf::max_block_data;
+    }
+
+    // appends the slices flush(mode) compresses
+    void slice(std::vector<slice_t>& slices, flush_t mode) {
+      const size_t step = slice_size();
+      const size_t end = (mode == flush_t::chunk) ? in_.size() - in_.size() % step : in_.size();
+      const size_t first = slices.size();
+      for (size_t begin = 0; begin < end; begin += step) {
+        slices.push_back({ this, begin, std::min(step, end - begin), false });
+      }
+      consumed_ = end;
+      if (mode == flush_t::chunk || mode == flush_t::spill) return;
+      switch (geo_.codec.kind) {
+        case codec_t::gzip: {
+          if (slices.size() > first) slices.back().finish = true;
+          else if (member_) slices.push_back({ this, end, 0, true });    // empty final block
+          break;
+        }
+        case codec_t::bgzf: {
+          if ((mode == flush_t::last) && !closed_) slices.push_back({ this, end, 0, true });
+          break;
+        }
+        default: break;
+      }
+    }
+
+    // pool thread, reads only
+    void compress(compressor_t& c, slice_t& s) const {
+      HAHI_TRACE_SCOPE("deflate");
+      const auto t0 = std::chrono::steady_clock::now();
+      const auto& codec = geo_.codec;
+      const char* in = in_.data() + s.begin;
+      s.crc = static_cast<uint32_t>(zng_crc32(0L, (const unsigned char*)in, s.len));
+      switch (codec.kind) {
+        case codec_t::none: break;
+        case codec_t::bgzf: {
+          if (s.len) {
+            zng_stream_reset(c.strm_, codec, codec.level);
+            s.size = bgzf::compress(c.strm_, in, s.len, c.out(bgzf::bound(s.len))).first;
+          }
+          break;
+        }
+        case codec_t::zstd: {
+          const auto cap = zstd::bound(s.len);
+          s.size = zstd::compress(c.cctx(), codec.zstd_level(), in, s.len, c.out(cap), cap);
+          break;
+        }
+        default: {
+          auto& strm = c.strm_;
+          zng_stream_reset(strm, codec, codec.level);
+          // priming: the preceding 32KiB of the member, from the window and the buffer
+          const size_t from_in = std::min(s.begin, dict_size);
+          const size_t from_window = std::min(window_.size(), dict_size - from_in);
+          c.dict_.assign(window_.data() + window_.size() - from_window, from_window);
+          c.dict_.append(in - from_in, from_in);
+          if (!c.dict_.empty() && (Z_OK != zng_deflateSetDictionary(&strm, (const unsigned char*)c.dict_.data(), static_cast<uint32_t>(c.dict_.size())))) {
+            throw std::runtime_error("fastq::demux_writer_t: failed to prime deflate stream");
+          }
+          const auto cap = zng_deflateBound(&strm, s.len) + 64;   // + sync flush
+          strm.next_in = (unsigned char*)in;
+          strm.avail_in = static_cast<uint32_t>(s.len);
+          strm.next_out = (unsigned char*)c.out(cap);
+          strm.avail_out = static_cast<uint32_t>(cap);
+          zng_deflate(&strm, s.finish ? Z_FINISH : Z_SYNC_FLUSH);
+          assert(strm.avail_in == 0);   // all input consumed
+          s.size = cap - strm.avail_out;
+          break;
+        }
+      }
+      s.time = std::chrono::steady_clock::now() - t0;
+    }
+
+    // caller's thread, slices in order. opens the file, see commit()
+    void write(const compressor_t& c, const slice_t& s) {
+      if (!file_) {
+        if (nullptr == (file_ = std::fopen(output_.string().c_str(), "ab"))) {
+          throw std::runtime_error(std::string("fastq::demux_writer_t: failed to open output file \'") + output_.string() + '\'');
+        }
+        staged_ = pos_;
+      }
+      auto write = [&](const char* buf, size_t n) {
+        if (n != std::fwrite(buf, 1, n, file_)) {
+          throw std::runtime_error(std::string("fastq::demux_writer_t: failed to write \'") + output_.string() + '\'');
+        }
+        staged_.file_bytes += n;
+      };
+      if (geo_.codec.framed() || (geo_.codec.kind == codec_t::none)) {
+        write((geo_.codec.kind == codec_t::none) ? in_.data() + s.begin : c.out_.data(), (geo_.codec.kind == codec_t::none) ? s.len : s.size);
+        staged_.crc = zng_crc32_combine(staged_.crc, s.crc, s.len);
+        staged_.bytes += s.len;
+        if (s.finish) write(bgzf::eof_block, bgzf::eof_block_size);
+      }
+      else {
+        if (!member_) {
+          write(writer_t<>::gz_header, sizeof(writer_t<>::gz_header) - 1);
+          crc_ = static_cast<uint32_t>(zng_crc32(0L, nullptr, 0));
+          member_bytes_ = 0;
+          member_ = true;
+        }
+        write(c.out_.data(), s.size);
+        crc_ = zng_crc32_combine(crc_, s.crc, s.len);
+        member_bytes_ += s.len;
+        if (s.finish) {
+          // write 8 byte gz footer (little endian)
+          const uint32_t gzcrc = htogz(crc_);
+          const uint64_t gzbytes = htogz(member_bytes_);
+          write((const char*)&gzcrc, 4);
+          write((const char*)&gzbytes, 4);
+          staged_.crc = zng_crc32_combine(staged_.crc, crc_, member_bytes_);
+          staged_.bytes += member_bytes_;
+          member_ = false;
+        }
+      }
+      tot_bytes_ += s.len;
+      deflate_time_ += s.time;
+    }
+
+    // closes the file, the position advances once the written slices are flushed
+    void commit() {
+      if (0 != std::fclose(std::exchange(file_, nullptr))) {
+        throw std::runtime_error(std::string("fastq::demux_writer_t: failed to write \'") + output_.string() + '\'');
+      }
+      pos_ = staged_;
+      tot_gz_bytes_ = pos_.file_bytes;
+    }
+
+    // drops the compressed input, gzip: its tail primes the next slice
+    void consume(flush_t mode) {
+      if ((mode == flush_t::chunk) && (geo_.codec.kind == codec_t::gzip) && consumed_) {
+        const size_t from_in = std::min(consumed_, dict_size);
+        window_.erase(0, window_.size() - std::min(window_.size(), dict_size - from_in));
+        window_.append(in_.data() + consumed_ - from_in, from_in);
+      }
+      in_.erase(0, consumed_);
+      if (geo_.budget) geo_.budget->release(consumed_);
+      consumed_ = 0;
+      if (mode != flush_t::chunk) {
+        buffer_t{}.swap(in_);
+        buffer_t{}.swap(window_);
+      }
+      if (mode == flush_t::last) closed_ = true;
+    }
+
+    const geometry_t geo_;
+    buffer_t in_;                 // buffered input
+    size_t consumed_ = 0;         // sliced by flush()
+    buffer_t window_;             // tail of the gzip member, primes the next slice
+    bool member_ = false;         // gzip member started
+    bool closed_ = true;
+    uint32_t crc_ = 0;            // of the gzip member
+    uint64_t member_bytes_ = 0;
+    size_t tot_bytes_ = 0;
+    size_t tot_gz_bytes_ = 0;
+    std::chrono::nanoseconds deflate_time_{0};
+    stream_pos_t pos_;            // on disk
+    stream_pos_t staged_;         // written into file_
+    FILE* file_ = nullptr;        // open during flush()
+    const std::filesystem::path output_;
+  };
+
+}
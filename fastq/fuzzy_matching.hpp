@@ -6,9 +6,12 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <utility>
+#include <span>
 #include <string_view>
 #include <numeric>  // iota, max
+#include <bit>
 #include <algorithm>
 #include <unordered_map>
 #include "fastq.hpp"
@@ -78,6 +81,29 @@ namespace fastq {
   }
 
 
+  // pairwise distance structure of a barcode set
+  inline correctability_t analyse_barcode(const barcode_t& bc) {
+    auto ca = correctability_t{};
+    if (bc.size() <= 2) return ca;
+    ca.min_ed = 1'000'000;
+    auto collides = std::vector<bool>(bc.size(), false);
+    for (size_t i = 1; i < bc.size(); ++i) {
+      for (size_t j = i + 1; j < bc.size(); ++j) {
+        const int ed = edit_distance(bc[i].code, bc[j].code, 1'000'000);
+        if (ed < ca.min_ed) {
+          ca.min_ed = ed;
+          ca.min_ed_pairs = 0;
+        }
+        ca.min_ed_pairs += (ed == ca.min_ed);
+        ca.duplicates += (ed == 0);
+        if (ed <= 2) collides[i] = collides[j] = true;
+      }
+    }
+    ca.collisions = std::count(collides.cbegin(), collides.cend(), true);
+    return ca;
+  }
+
+
   enum ReadType{
     invalid,        // code length violation
     unclear,        // multiple occurrences of same min ed
@@ -94,8 +120,60 @@ namespace fastq {
   };
 
 
+  // substitution-only matching against the bit-sliced positional index of bc.
+  // mismatch counts for all codes are accumulated by saturating bit-sliced
+  // adders (c1: >= 1 mismatch, c2: >= 2 mismatches), a few word operations per position.
+  // returns true if decided: exact match, unique 1-mismatch or tied 1-mismatches.
+  // the latter two are safe because ed == 1 between equal length strings implies a
+  // single substitution, i.e. no indel can compete.
+  inline bool pos_index_match(str_view RX, const barcode_t& bc, match_t& m) noexcept {
+    if (!bc.has_pos_index() || (RX.length() != bc.max_code_length())) return false;
+    const size_t W = bc.pos_index_words();
+    uint64_t c1[W];
+    uint64_t c2[W];
+    std::fill_n(c1, W, 0);
+    std::fill_n(c2, W, 0);
+    for (size_t pos = 0; pos < RX.length(); ++pos) {
+      const int base = base_code(RX[pos]);
+      const uint64_t* mask = (base >= 0) ? bc.pos_mask(pos, base) : nullptr;
+      uint64_t alive = 0;
+      for (size_t w = 0; w < W; ++w) {
+        const uint64_t X = mask ? ~mask[w] : ~uint64_t(0);
+        c2[w] |= c1[w] & X;
+        c1[w] |= X;
+        alive |= ~c2[w] & bc.pos_valid(w);
+      }
+      if (0 == alive) return false;   // min ed >= 2 
+    }
+    int ones = 0;
+    int idx = 0;
+    for (size_t w = 0; w < W; ++w) {
+      if (const uint64_t exact = ~c1[w] & bc.pos_valid(w); exact) {
+        m = { .idx = static_cast<int>(64 * w + std::countr_zero(exact)) + 1, .ed = 0, .rt = ReadType::correct };
+        return true;
+      }
+      if (const uint64_t one = c1[w] & ~c2[w] & bc.pos_valid(w); one) {
+        if (0 == ones) idx = static_cast<int>(64 * w + std::countr_zero(one)) + 1;
+        ones += std::popcount(one);
+      }
+    }
+    if (1 == ones) {
+      m = { .idx = idx, .ed = 1, .rt = ReadType::corrected };
+      return true;
+    }
+    if (ones > 1) {
+      m = { .idx = 0, .ed = 1, .rt = ReadType::unclear };
+      return true;
+    }
+    return false;
+  }
+
+
   inline match_t min_edit_distance(str_view RX, size_t code_length, const barcode_t& bc) {
     if (RX.length() < code_length) return {};  // invalid
+    if (const int idx = bc.exact_match(RX); idx) return { .idx = idx, .ed = 0, .rt = ReadType::correct };
+    if (const int idx = bc.radius1_match(RX); idx) return { .idx = idx, .ed = 1, .rt = ReadType::corrected };
+    if (match_t m; pos_index_match(RX, bc, m)) return m;
     int min_ed = 1'000'000;
     int idx = 0;
     ReadType rt = ReadType::unclear;
@@ -121,5 +199,135 @@ namespace fastq {
   inline match_t min_edit_distance(str_view RX, const barcode_t& bc) {
     return min_edit_distance(RX, bc.max_code_length(), bc);
   }
+
+
+  namespace detail {
+
+    constexpr size_t match_lanes = 32;        // reads processed side by side
+    constexpr size_t max_lane_length = 32;    // max. window length handled by lanes
+
+  }
+
+
+  // batched min_edit_distance over many reads against the same barcode set.
+  // windows are gathered position-major into a packed buffer (win[pos][lane])
+  // such that the dp-recurrence runs over lanes (reads) in the innermost loop,
+  // which vectorizes nicely.
+  // results are identical to calling min_edit_distance for each read.
+  inline void match_block(std::span<const str_view> RX, size_t code_length, const barcode_t& bc, std::span<match_t> res) {
+    assert(RX.size() == res.size());
+    constexpr size_t L = detail::match_lanes;
+    constexpr size_t M = detail::max_lane_length;
+    if ((bc.size() <= 1) || (bc.max_code_length() > 255 - M)) {
+      // nothing to vectorize or uint8_t distance overflow
+      for (size_t i = 0; i < RX.size(); ++i) res[i] = min_edit_distance(RX[i], code_length, bc);
+      return;
+    }
+    alignas(64) char win[M][L];           // packed windows
+    alignas(64) uint8_t D[M + 1][L];      // single row of the distance matrix per lane
+    alignas(64) uint8_t diag[L];
+    size_t len[L];
+    bool lane[L];       // handled by lanes
+    bool active[L];     // no exact match yet
+    int min_ed[L];
+    int idx[L];
+    ReadType rt[L];
+    for (size_t i0 = 0; i0 < RX.size(); i0 += L) {
+      const size_t n = std::min(L, RX.size() - i0);
+      // gather
+      size_t m = 0;   // longest window in tile
+      size_t num_active = 0;
+      for (size_t l = 0; l < L; ++l) {
+        lane[l] = active[l] = false;
+        len[l] = 0;
+        if (l < n) {
+          const auto rx = RX[i0 + l];
+          if (rx.length() < code_length) {
+            res[i0 + l] = {};   // invalid
+          }
+          else if (rx.length() > M) [[unlikely]] {
+            res[i0 + l] = min_edit_distance(rx, code_length, bc);
+          }
+          else if (const int idx = bc.exact_match(rx); idx) {
+            res[i0 + l] = { .idx = idx, .ed = 0, .rt = ReadType::correct };
+          }
+          else if (const int idx = bc.radius1_match(rx); idx) {
+            res[i0 + l] = { .idx = idx, .ed = 1, .rt = ReadType::corrected };
+          }
+          else if (pos_index_match(rx, bc, res[i0 + l])) {
+            // decided by positional index
+          }
+          else {
+            lane[l] = active[l] = true;
+            len[l] = rx.length();
+            m = std::max(m, len[l]);
+            ++num_active;
+          }
+        }
+        min_ed[l] = 1'000'000;
+        idx[l] = 0;
+        rt[l] = ReadType::unclear;
+      }
+      if (0 == num_active) continue;
+      for (size_t j = 0; j < m; ++j) {
+        for (size_t l = 0; l < L; ++l) {
+          win[j][l] = (j < len[l]) ? RX[i0 + l][j] : '\0';
+        }
+      }
+      // scan barcodes
+      for (size_t i = 1; (i < bc.size()) && num_active; ++i) {
+        const auto& code = bc[i].code;
+        for (size_t j = 0; j <= m; ++j) {
+          for (size_t l = 0; l < L; ++l) D[j][l] = static_cast<uint8_t>(j);
+        }
+        for (size_t k = 1; k <= code.length(); ++k) {
+          const char ck = code[k - 1];
+          for (size_t l = 0; l < L; ++l) {
+            diag[l] = D[0][l];
+            D[0][l] = static_cast<uint8_t>(k);
+          }
+          for (size_t j = 1; j <= m; ++j) {
+            for (size_t l = 0; l < L; ++l) {
+              const uint8_t sub = diag[l] + (win[j - 1][l] != ck);
+              const uint8_t ins = std::min(D[j][l], D[j - 1][l]) + 1;
+              diag[l] = D[j][l];
+              D[j][l] = std::min(sub, ins);
+            }
+          }
+        }
+        // reduce, mimics min_edit_distance
+        for (size_t l = 0; l < L; ++l) {
+          if (!active[l]) continue;
+          const int ed = D[len[l]][l];
+          if (min_ed[l] > ed) {
+            idx[l] = static_cast<int>(i);
+            if (0 == (min_ed[l] = ed)) [[unlikely]] {
+              rt[l] = ReadType::correct;
+              active[l] = false;    // assuming unique barcodes
+              --num_active;
+            }
+            else {
+              rt[l] = ReadType::corrected;
+            }
+          }
+          else if (min_ed[l] == ed) {
+            rt[l] = ReadType::unclear;
+          }
+        }
+      }
+      // scatter
+      for (size_t l = 0; l < n; ++l) {
+        if (lane[l]) {
+          res[i0 + l] = { .idx = (rt[l] == ReadType::unclear) ? 0 : idx[l], .ed = min_ed[l], .rt = rt[l] };
+        }
+      }
+    }
+  }
+
+
+  // match_block, assuming code_length = bc.max_code_length()
+  inline void match_block(std::span<const str_view> RX, const barcode_t& bc, std::span<match_t> res) {
+    match_block(RX, bc.max_code_length(), bc, res);
+  }
   
 }
@@ -0,0 +1,158 @@
+/* fastq/layout.hpp
+ *
+ * Copyright (c) 2025 Hanno Hildenbrandt <h.hildenbrandt@rug.nl>
+ */
+
+/*
+ * read structure: where the barcode segments sit in the reads.
+ *
+ * segments are matched in order. offset and length of a segment's window
+ * are expressions "<term>[+<term>...]" with the terms
+ *   <n>            constant (spacer)
+ *   <seg>          max. code length of the segment's barcode set
+ *   <seg>.min      min. code length of the segment's barcode set
+ *   <seg>.len      length of the matched code, max. code length if unclear
+ *   <seg>.shift    matched index - 1, 0 if unclear or invalid (stagger, sorted set)
+ *   <seg>.end      end of the segment's window, offset + length
+ * where .len, .shift and .end refer to segments matched before (dynamic terms).
+ * windows shorter than their length are invalid.
+ *
+ * expressions are compiled into a constant and a (usually empty) list of
+ * dynamic terms, .end of static segments is folded into the constant.
+ * static windows take the fast path.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <vector>
+#include <span>
+#include "fastq.hpp"
+#include "barcode.hpp"
+#include "fuzzy_matching.hpp"
+
+
+namespace fastq {
+
+  class layout_t {
+  public:
+    struct term_t {
+      enum kind_t { len, shift, end };
+      kind_t kind;
+      unsigned seg;
+    };
+
+    struct expr_t {
+      size_t constant = 0;
+      std::vector<term_t> terms;    // dynamic part
+      std::string src;              // as given
+
+      bool is_static() const noexcept { return terms.empty(); }
+    };
+
+    // segment as given
+    struct spec_t {
+      std::string name;
+      const barcode_t* bc;
+      unsigned read;              // caller's read index
+      std::string offset;
+      std::string length = {};    // default: <name>
+    };
+
+    struct segment_t {
+      std::string name;
+      const barcode_t* bc;
+      unsigned read;
+      expr_t offset;
+      expr_t length;
+
+      bool is_static() const noexcept { return offset.is_static() && length.is_static(); }
+    };
+
+    layout_t() = default;
+
+    explicit layout_t(const std::vector<spec_t>& specs) {
+      for (const auto& spec : specs) {
+        if (find(spec.name) != -1) throw std::runtime_error("layout: duplicated segment '" + spec.name + '\'');
+        segs_.push_back({ spec.name, spec.bc, spec.read, {}, {} });
+      }
+      for (size_t i = 0; i < specs.size(); ++i) {
+        segs_[i].offset = compile(specs[i].offset, i);
+        segs_[i].length = compile(specs[i].length.empty() ? specs[i].name : specs[i].length, i);
+      }
+    }
+
+    size_t size() const noexcept { return segs_.size(); }
+    const segment_t& operator[](size_t i) const noexcept { return segs_[i]; }
+    auto begin() const noexcept { return segs_.begin(); }
+    auto end() const noexcept { return segs_.end(); }
+
+    // index of segment, -1 if not found
+    int find(std::string_view name) const noexcept {
+      for (size_t i = 0; i < segs_.size(); ++i) {
+        if (segs_[i].name == name) return static_cast<int>(i);
+      }
+      return -1;
+    }
+
+    // compiles expression, dynamic terms may refer to the first 'before' segments
+    expr_t compile(std::string_view src, size_t before = size_t(-1)) const {
+      auto expr = expr_t{ .constant = 0, .terms = {}, .src = std::string(src) };
+      while (!src.empty()) {
+        const auto plus = src.find('+');
+        auto tok = src.substr(0, plus);
+        src.remove_prefix((plus == src.npos) ? src.size() : plus + 1);
+        while (tok.starts_with(' ')) tok.remove_prefix(1);
+        while (tok.ends_with(' ')) tok.remove_suffix(1);
+        if (tok.empty()) throw std::runtime_error("layout: empty term in '" + expr.src + '\'');
+        size_t val = 0;
+        if (auto [p, ec] = std::from_chars(tok.data(), tok.data() + tok.size(), val); (ec == std::errc{}) && (p == tok.data() + tok.size())) {
+          expr.constant += val;
+          continue;
+        }
+        const auto dot = tok.find('.');
+        const auto name = tok.substr(0, dot);
+        const auto attr = (dot == tok.npos) ? str_view{} : tok.substr(dot + 1);
+        const int seg = find(name);
+        if (seg == -1) throw std::runtime_error("layout: unknown segment in '" + expr.src + '\'');
+        const auto& bc = *segs_[seg].bc;
+        if (attr.empty()) expr.constant += bc.max_code_length();
+        else if (attr == "min") expr.constant += bc.min_code_length();
+        else if ((attr == "end") && (size_t(seg) < before) && segs_[seg].is_static()) {
+          expr.constant += segs_[seg].offset.constant + segs_[seg].length.constant;    // folded
+        }
+        else {
+          term_t term{ term_t::len, static_cast<unsigned>(seg) };
+          if (attr == "shift") term.kind = term_t::shift;
+          else if (attr == "end") term.kind = term_t::end;
+          else if (attr != "len") throw std::runtime_error("layout: unknown attribute in '" + expr.src + '\'');
+          if (size_t(seg) >= before) throw std::runtime_error("layout: '" + expr.src + "' refers to a segment not matched before");
+          expr.terms.push_back(term);
+        }
+      }
+      return expr;
+    }
+
+    // m, end: per segment match and window end of one read
+    size_t eval(const expr_t& expr, std::span<const match_t> m, std::span<const uint32_t> end) const noexcept {
+      size_t val = expr.constant;
+      for (const auto& t : expr.terms) {
+        const auto& x = m[t.seg];
+        switch (t.kind) {
+          case term_t::len: val += (x.rt == ReadType::unclear) ? segs_[t.seg].bc->max_code_length() : (*segs_[t.seg].bc)[x.idx].code.length(); break;
+          case term_t::shift: val += (x.rt <= ReadType::unclear) ? 0 : x.idx - 1; break;
+          case term_t::end: val += end[t.seg]; break;
+        }
+      }
+      return val;
+    }
+
+  private:
+    std::vector<segment_t> segs_;
+  };
+
+}
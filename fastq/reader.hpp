@@ -16,6 +16,7 @@
 #include <thread>
 #include <future>
 #include <atomic>
+#include <chrono>
 #include <utility>
 #include <array>
 #include <list>
@@ -23,7 +24,10 @@
 #include <string_view>
 #include <device/queue.hpp>
 #include <device/mutex.hpp>
+#include <device/budget.hpp>
+#include <device/trace.hpp>
 #include "fastq.hpp"
+#include "codec.hpp"
 
 
 namespace fastq {
@@ -57,7 +61,7 @@ namespace fastq {
   namespace detail {
 
     // asynchronous wrapper around `zlib::gzread`
-    // as such, accepts uncompressed files too
+    // as such, accepts uncompressed files too. zstd files by magic number.
     template <
       typename Allocator,
       size_t Window = 16 * 1024,          // shall be bigger than max item size
@@ -70,28 +74,43 @@ namespace fastq {
       static_assert(Window < (ChunkSize >> 4));
       static_assert(ChunkSize < std::numeric_limits<int>::max());   // zlib limitation
       static constexpr size_t window = Window;
-      static constexpr size_t chunk_size = ChunkSize;
-      static constexpr unsigned chunks = Chunks;
-      static constexpr unsigned gz_buffer = GzBuffer;
       using allocator_t = Allocator;
 
+      // runtime buffer geometry, defaults to template arguments
+      struct geometry_t {
+        size_t chunk_size = ChunkSize;
+        unsigned chunks = Chunks;
+        unsigned gz_buffer = GzBuffer;
+        std::shared_ptr<hahi::budget_t> budget = nullptr;   // optional, shared memory budget
+      };
+
       reader_t() = default;
       reader_t(reader_t&&) = default;
       reader_t& operator=(reader_t&&) = default;
       
-      explicit reader_t(const std::filesystem::path& path) : path_(path) {
-        if (nullptr == (gzin_ = zng_gzopen(path.string().c_str(), "rb"))) {
-          throw std::runtime_error(std::string("fastq::reader_t: failed to open input file \'") + path.string() + '\'');
+      // preloaded: decompressed content of path, served from memory
+      explicit reader_t(const std::filesystem::path& path, const geometry_t& geo = {}, std::shared_ptr<const std::string> preloaded = nullptr) 
+      : chunks_(geo.chunks), geo_(geo), path_(path) {
+        if ((window >= (geo.chunk_size >> 4)) || (geo.chunk_size >= size_t(std::numeric_limits<int>::max())) || (geo.chunks == 0)) {
+          throw std::runtime_error("fastq::reader_t: invalid geometry");
         }
-        zng_gzbuffer(gzin_, gz_buffer);
-        deflate_ = std::jthread([&, gzin = gzin_](std::stop_token stok) {
+        in_ = preloaded ? std::make_unique<infile_t>(std::move(preloaded)) : std::make_unique<infile_t>(path, geo.gz_buffer);
+        deflate_ = std::jthread([&, in = in_.get(), chunk_size = geo.chunk_size](std::stop_token stok) {
+          HAHI_TRACE_THREAD("reader " + path_.filename().string());
           try {
             while (!stok.stop_requested()) {
-              auto buf =  chunk_ptr(static_cast<char*>(alloc_.alloc(chunk_size + window)), &allocator_t::free);
-              const auto avail = static_cast<size_t>(zng_gzread(gzin, buf.get() + window, static_cast<unsigned>(chunk_size)));
+              auto buf = alloc_chunk(stok, chunk_size + window);
+              size_t avail = 0;
+              {
+                HAHI_TRACE_SCOPE("inflate");
+                const auto t0 = std::chrono::steady_clock::now();
+                avail = static_cast<size_t>(in->read(buf.get() + window, static_cast<unsigned>(chunk_size)));
+                inflate_time_.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+              }
               if (avail == size_t(-1)) {  // error
                 throw -1;
               }
+              gz_bytes_.store(in->offset(), std::memory_order_relaxed);
               const bool last = avail < chunk_size;
               chunks_.push(chunk_t{ .buf = std::move(buf), .size = avail, .window = window, .last = last});
               if (last) {   // eof
@@ -111,14 +130,25 @@ namespace fastq {
         // gracefully end worker threads if necessary
         deflate_.request_stop();
         if (deflate_.joinable()) {
+          if (geo_.budget) geo_.budget->notify();   // blocked in alloc_chunk
           while (chunks_.try_pop().has_value()) ;   // deplete file queue. allow reader_ to push sentinel
           deflate_.join();
         }
-        zng_gzclose(gzin_);
       }
 
       // bytes deflated
-      size_t tot_bytes() const noexcept { return tot_bytes_; }
+      size_t tot_bytes() const noexcept { return tot_bytes_.load(std::memory_order_relaxed); }
+
+      // compressed bytes consumed from file
+      size_t gz_bytes() const noexcept { return gz_bytes_.load(std::memory_order_relaxed); }
+
+      // time spent reading and decompressing
+      std::chrono::nanoseconds inflate_time() const noexcept { return std::chrono::nanoseconds(inflate_time_.load(std::memory_order_relaxed)); }
+
+      const geometry_t& geometry() const noexcept { return geo_; }
+
+      // chunk queue, telemetry
+      const hahi::concurrent_queue<chunk_t>& queue() const noexcept { return chunks_; }
       bool failed() const noexcept { return fail_.load(std::memory_order_acquire); }
       bool eof() const noexcept { return eof_; }
       const std::filesystem::path& path() const noexcept { return path_; }
@@ -128,21 +158,45 @@ namespace fastq {
       chunk_t operator()() {
         if (!eof_) {
           auto chunk = chunks_.pop(); 
-          tot_bytes_ += chunk.size;
+          tot_bytes_.store(tot_bytes_.load(std::memory_order_relaxed) + chunk.size, std::memory_order_relaxed);
           eof_ = chunk.last | fail_.load(std::memory_order_acquire);
+          if (geo_.budget && (chunks_.size() == 0)) geo_.budget->notify();   // starving, see alloc_chunk
           return chunk;
         }
         return {};
       }
 
     private:
-      mutable hahi::concurrent_queue<chunk_t> chunks_{chunks};
+      // draws from the budget, if any. blocks while the budget is exhausted,
+      // unless the consumer starves (empty queue), which keeps the pipeline alive.
+      chunk_ptr alloc_chunk(const std::stop_token& stok, size_t bytes) {
+        auto& budget = geo_.budget;
+        if (!budget) return chunk_ptr(static_cast<char*>(alloc_.alloc(bytes)), &allocator_t::free);
+        budget->acquire(bytes, [&]() { return stok.stop_requested() || (chunks_.size() == 0); });
+        char* ptr = nullptr;
+        try {
+          ptr = static_cast<char*>(alloc_.alloc(bytes));
+        }
+        catch (...) {
+          budget->release(bytes);
+          throw;
+        }
+        return chunk_ptr(ptr, [budget, bytes](char* ptr) {
+          allocator_t::free(ptr);
+          budget->release(bytes);
+        });
+      }
+
+      mutable hahi::concurrent_queue<chunk_t> chunks_{Chunks};
       mutable std::atomic<bool> fail_{false};
-      size_t tot_bytes_ = 0;
+      std::atomic<size_t> tot_bytes_ = 0;    // single writer
+      std::atomic<size_t> gz_bytes_ = 0;
+      std::atomic<int64_t> inflate_time_ = 0;    // ns
       bool eof_ = false;
+      geometry_t geo_;
       allocator_t alloc_;
       std::jthread deflate_;
-      gzFile gzin_ = nullptr;
+      std::unique_ptr<infile_t> in_;
       const std::filesystem::path path_;
     };
 
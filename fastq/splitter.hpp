@@ -101,7 +101,10 @@ namespace fastq {
     base_splitter(base_splitter&&) = default;
     base_splitter& operator=(base_splitter&&) = default;
 
-    explicit base_splitter(const std::filesystem::path& path) : reader_(std::make_shared<Reader>(path)) {}
+    // args: optional Reader arguments, e.g. Reader::geometry_t
+    template <typename... Args>
+    explicit base_splitter(const std::filesystem::path& path, Args&&... args) 
+    : reader_(std::make_shared<Reader>(path, std::forward<Args>(args)...)) {}
 
     bool eof() const noexcept { return last_ && chunk_splitter_.empty(); }
     bool failed() const noexcept { return !reader_ || reader_->failed(); }
@@ -120,7 +123,6 @@ namespace fastq {
     // returns views into up to n items
     // valid over the live time of the returned object
     blk_reads_t<value_type> operator()(size_t n) {
-      using allocator = Reader::allocator_t;
       auto v = std::vector<value_type>{};
       v.reserve(n);
       shared_storage_ = std::vector<chunk_t>{chunk_splitter_.chunk()};
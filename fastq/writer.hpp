@@ -11,20 +11,37 @@
 #pragma once
 
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <stdexcept>
 #include <filesystem>
 #include <fstream>
+#include <array>
 #include <vector>
+#include <deque>
+#include <optional>
 #include <span>
 #include <string_view>
 #include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <utility>
 #include <bit>
 #include <device/pool.hpp>
+#include <device/mutex.hpp>
+#include <device/budget.hpp>
+#include <device/trace.hpp>
 #include "fastq.hpp"
+#include "bgzf.hpp"
+#include "codec.hpp"
+
+#ifdef FASTQ_LINUX
+# include <fcntl.h>
+#endif
 
 
 namespace fastq {
@@ -33,9 +50,9 @@ namespace fastq {
   namespace {
 
     // initialize a raw deflate stream (no header, no checksum)
-    inline void zng_stream_init(zng_stream& strm) {
+    inline void zng_stream_init(zng_stream& strm, const codec_t& codec) {
       std::memset(&strm, 0, sizeof(zng_stream));
-      auto ret = zng_deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY);
+      auto ret = zng_deflateInit2(&strm, codec.deflate_level(), Z_DEFLATED, -15, 9, codec.strategy);
       if (ret == Z_MEM_ERROR) {
         throw std::runtime_error("fastq::zng_stream_init: not enough memory");
       }
@@ -45,9 +62,9 @@ namespace fastq {
     }
 
 
-    inline void zng_stream_reset(zng_stream& strm) {
+    inline void zng_stream_reset(zng_stream& strm, const codec_t& codec, int level) {
       (void)zng_deflateReset(&strm);
-      (void)zng_deflateParams(&strm, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+      (void)zng_deflateParams(&strm, codec.deflate_level(level), codec.strategy);
     }
 
 
@@ -92,6 +109,14 @@ namespace fastq {
 
   }
 
+
+  // position in a gzip stream at a gzip member boundary
+  struct stream_pos_t {
+    size_t file_bytes = size_t(-1);   // compressed size
+    size_t bytes = 0;                 // uncompressed size
+    uint32_t crc = 0;                 // crc32 of uncompressed stream
+  };
+
   
   template <
     unsigned CHUNK_SIZE = 1024 * 1024,    // per thread
@@ -100,28 +125,84 @@ namespace fastq {
   class writer_t {
   public:
     static constexpr char gz_header[] = "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03";
-    static constexpr unsigned chunks = CHUNKS;
-    static constexpr unsigned chunk_size = CHUNK_SIZE;
+    using buffer_t = std::string;
 
-    unsigned tot_chunk_size() const noexcept { return num_threads_ * chunk_size; }
+    // runtime buffer geometry, defaults to template arguments
+    struct geometry_t {
+      unsigned chunk_size = CHUNK_SIZE;   // per thread
+      unsigned chunks = CHUNKS;           // in flight
+      codec_t codec = {};                 // output format and level
+      std::shared_ptr<hahi::budget_t> budget = nullptr;   // optional, charged for queued input
+    };
+
+    const geometry_t& geometry() const noexcept { return geo_; }
+    unsigned tot_chunk_size() const noexcept { return num_threads_ * geo_.chunk_size; }
     unsigned num_threads() const noexcept { return num_threads_; }
     
     // approximated bytes compressed, accurate after close    
     size_t tot_bytes() const noexcept { return tot_bytes_written_.load(std::memory_order_relaxed); }
 
-    writer_t(const std::filesystem::path& output, std::shared_ptr<hahi::pool_t> pool, unsigned num_threads = -1) 
-    : in_chunks_{chunks},
+    // compressed bytes written so far
+    size_t tot_gz_bytes() const noexcept { return tot_gz_bytes_.load(std::memory_order_relaxed); }
+
+    // input queue, telemetry
+    const auto& queue() const noexcept { return in_chunks_; }
+
+    // time spent compressing, summed over pool threads
+    std::chrono::nanoseconds deflate_time() const noexcept { return std::chrono::nanoseconds(deflate_time_.load(std::memory_order_relaxed)); }
+
+    // current compression level, codec level if not adaptive
+    int level() const noexcept { return level_.load(std::memory_order_relaxed); }
+
+    // mean compression level over all rounds so far
+    double mean_level() const noexcept {
+      const auto rounds = rounds_.load(std::memory_order_relaxed);
+      return rounds ? double(level_sum_.load(std::memory_order_relaxed)) / rounds : double(level());
+    }
+
+    // end of stream, valid after close(true)
+    const stream_pos_t& stream_pos() const noexcept { return pos_; }
+
+    // append.file_bytes != -1: truncates existing output to append.file_bytes and
+    // appends a new gzip member (resume from sync()). 
+    // output "-" is stdout.
+    writer_t(const std::filesystem::path& output, std::shared_ptr<hahi::pool_t> pool, unsigned num_threads = -1, const stream_pos_t& append = {}, const geometry_t& geo = {}) 
+    : in_chunks_{geo.chunks},
+      geo_(geo),
       num_threads_(num_threads),
       shpool_(pool),
       output_(output)
     {
-      if (num_threads_ == -1) num_threads_ = pool->num_threads();
+      if (num_threads_ == unsigned(-1)) num_threads_ = pool->num_threads();
       num_threads_ = std::clamp(num_threads_, 1u, pool->num_threads());
-      auto gzout = std::ofstream(output, std::ios::binary);
-      gzout.write(gz_header, sizeof(gz_header) - 1);
+      if ((geo_.chunk_size < 4096) || (geo_.chunks == 0)) {
+        throw std::runtime_error("fastq::writer_t: invalid geometry");
+      }
+      auto mode = std::ios::binary;
+      if (append.file_bytes != size_t(-1)) {
+        std::filesystem::resize_file(output, append.file_bytes);
+        mode |= std::ios::app;
+        pos_ = append;
+      }
+      else {
+        pos_ = { 0, 0, zng_crc32(0L, nullptr, 0) };
+      }
+      spares_.reserve(max_spares);
+      if (geo_.codec.kind == codec_t::none) {
+        closed_ = false;
+        in_chunk_.reserve(tot_chunk_size());
+        launch_passthrough(append.file_bytes != size_t(-1));
+        return;
+      }
+      auto gzout = std::ofstream((output == "-") ? std::filesystem::path("/dev/stdout") : output, mode);
+      if (!gzout) throw std::runtime_error(std::string("fastq::writer_t: failed to open output file \'") + output.string() + '\'');
+      if (geo_.codec.kind == codec_t::gzip) {
+        gzout.write(gz_header, sizeof(gz_header) - 1);
+        pos_.file_bytes += sizeof(gz_header) - 1;
+      }
       closed_ = false;
       in_chunk_.reserve(tot_chunk_size());
-      launch_compressor(std::move(gzout), shpool_, num_threads);
+      launch_compressor(std::move(gzout));
     }
 
     ~writer_t() {
@@ -138,7 +219,7 @@ namespace fastq {
     void close(bool join = false) {
       if (closed_) return;
       closed_ = true;
-      in_chunks_.emplace(std::move(in_chunk_)); // last, incomplete chunk
+      hand_over(true);    // last, incomplete chunk
       if (join && compressor_.joinable()) {
         compressor_.join();
       }
@@ -170,15 +251,105 @@ namespace fastq {
       }
     }
 
+    // hands over a whole buffer rendered elsewhere.
+    // the buffer is compressed in place, pending put()-data is flushed first.
+    void submit(buffer_t&& buf) {
+      if (closed_) throw std::runtime_error("fastq_writer: attempt to write into closed stream");
+      if (buf.empty()) return;
+      if (!in_chunk_.empty()) hand_over(false);
+      enqueue({ std::move(buf), false });
+    }
+
+    void submit(std::span<buffer_t> bufs) {
+      for (auto& buf : bufs) submit(std::move(buf));
+    }
+
+    // finishes the current gzip member (CRC and length trailer) and starts a new one.
+    // the returned future becomes ready once everything submitted before is
+    // on disk and yields the stream position at the member boundary.
+    std::future<stream_pos_t> sync() {
+      if (closed_) throw std::runtime_error("fastq_writer: attempt to sync closed stream");
+      auto promise = std::make_shared<std::promise<stream_pos_t>>();
+      auto future = promise->get_future();
+      hand_over(false, std::move(promise));
+      return future;
+    }
+
   private:
+    struct in_chunk_t;
+
+    // queued input draws from the budget, released once consumed.
+    // blocks while the budget is exhausted, unless the compressor starves.
+    void enqueue(in_chunk_t&& in) {
+      if (geo_.budget) geo_.budget->acquire(in.buf.size(), [&]() { return (in_chunks_.size() == 0) || failed(); });
+      in_chunks_.push(std::move(in));
+      signal();
+    }
+
+    // wakes the compressor waiting for input or a slice, see wait_event()
+    void signal(bool* done = nullptr) {
+      {
+        std::lock_guard<std::mutex> _(event_mutex_);
+        if (done) *done = true;
+        ++events_;
+      }
+      event_cv_.notify_one();
+    }
+
+    uint64_t events() {
+      std::lock_guard<std::mutex> _(event_mutex_);
+      return events_;
+    }
+
+    // blocks until something happened after events() returned seen
+    void wait_event(uint64_t seen) {
+      std::unique_lock<std::mutex> lock(event_mutex_);
+      event_cv_.wait(lock, [&]() { return events_ != seen; });
+    }
+
+    // consumed input, put()-buffers go back to the spares
+    void release(in_chunk_t& in) noexcept {
+      if (geo_.budget) geo_.budget->release(in.buf.size());
+      if (in.spare && (in.buf.capacity() >= tot_chunk_size())) {
+        in.buf.clear();
+        std::lock_guard<hahi::spin_lock> _(spare_mutex_);
+        if (spares_.size() < max_spares) spares_.push_back(std::move(in.buf));    // reserved, no allocation
+      }
+    }
+
+    // enqueues the put()-buffer, the next do_put takes a spare
+    void hand_over(bool last, std::shared_ptr<std::promise<stream_pos_t>> sync = nullptr) {
+      enqueue({ std::exchange(in_chunk_, buffer_t{}), last, std::move(sync), true });
+    }
+
+    // recycled put()-buffer at full capacity, new one if none is spare
+    buffer_t spare_buffer() {
+      {
+        std::lock_guard<hahi::spin_lock> _(spare_mutex_);
+        if (!spares_.empty()) {
+          auto buf = std::move(spares_.back());
+          spares_.pop_back();
+          return buf;
+        }
+      }
+      auto buf = buffer_t{};
+      buf.reserve(tot_chunk_size());
+      return buf;
+    }
+
+    // str might span multiple chunks
     template <bool newline>
     void do_put(str_view str) {
-      assert((str.length() + newline) < tot_chunk_size());
-      auto avail = tot_chunk_size() - in_chunk_.size();
-      if (avail < str.length() + newline) {
+      if (in_chunk_.capacity() < tot_chunk_size()) [[unlikely]] {
+        assert(in_chunk_.empty());    // handed over
+        in_chunk_ = spare_buffer();
+      }
+      while (tot_chunk_size() - in_chunk_.size() < str.length() + newline) {
+        const auto avail = tot_chunk_size() - in_chunk_.size();
         in_chunk_.insert(in_chunk_.end(), str.cbegin(), str.cbegin() + avail);
         assert(in_chunk_.length() == tot_chunk_size());
-        in_chunks_.emplace(std::move(in_chunk_));
+        hand_over(false);
+        in_chunk_ = spare_buffer();
         str.remove_prefix(avail);
       }
       in_chunk_.insert(in_chunk_.cend(), str.cbegin(), str.cend());
@@ -188,94 +359,354 @@ namespace fastq {
     }
 
     // inspired by Mark Adler's pigz code: https://zlib.net/pigz/
-    void launch_compressor(std::ofstream&& gzout, auto shpool, unsigned nun_threads) {
+    // continuous: a slice is submitted as soon as its input is available and a
+    // stream slot is free, finished slices are written in order as they complete.
+    // gzip slices are primed with the preceding 32KiB of the member (deflateSetDictionary),
+    // thus they compress about as well as one long stream.
+    void launch_compressor(std::ofstream&& gzout) {
       compressor_ = std::thread([&, gzout = std::move(gzout), pool = shpool_.get(), nt = num_threads_]() mutable {
-        using cfuture = std::future<std::pair<char* /* out buf */, uint32_t /* avail */>>;
-        auto cf = std::vector<cfuture>{};
+        struct slice_t {
+          char* out;
+          size_t size;      // compressed
+          uint32_t crc;     // framed codecs only
+        };
+        // slice in flight, uses stream slot njobs % nt
+        struct job_t {
+          std::future<slice_t> f = {};   // invalid: empty slice of framed codecs
+          size_t len = 0;             // uncompressed
+          size_t buf = 0;             // input buffer (sequence number)
+          bool finish = false;        // last slice of gzip member
+          bool last = false;          // last slice of stream
+          uint32_t crc = 0;           // member crc, !framed && finish
+          uint64_t member_bytes = 0;  // member size, !framed && finish
+          std::shared_ptr<std::promise<stream_pos_t>> sync = nullptr;
+          bool done = false;          // slice computed (or failed), guarded by event_mutex_
+        };
+        HAHI_TRACE_THREAD("writer " + output_.filename().string());
 
-        // set up numtreads zng_streams
-        const size_t gz_buffer = (4 * chunk_size) / 3;
+        // set up numtreads zng_streams (zstd: slice descriptors only)
+        const auto codec = geo_.codec;
+        const bool framed = codec.framed();
+        const size_t chunk_size = (codec.kind == codec_t::bgzf) 
+                                ? std::max<size_t>(1, geo_.chunk_size / bgzf::max_block_data) * bgzf::max_block_data   // whole blocks
+                                : geo_.chunk_size;
+        const size_t gz_buffer = (codec.kind == codec_t::bgzf) ? bgzf::bound(chunk_size) 
+                               : (codec.kind == codec_t::zstd) ? zstd::bound(chunk_size)
+                               : (4 * chunk_size) / 3;
+        constexpr size_t dict_size = 32 * 1024;   // deflate window
         std::vector<zng_stream> strms{size_t(nt)};
         for (auto& strm : strms) {
           std::memset(&strm, 0, sizeof(strm));
         }
+        auto cctxs = std::vector<ZSTD_CCtx*>(nt, nullptr);
+        // referenced by running jobs, outlive them
+        auto raw_out = std::unique_ptr<char[]>{};
+        auto dicts = std::vector<std::array<char, dict_size>>{};   // per slot, gzip
+        auto bufs = std::deque<in_chunk_t>{};    // input referenced by jobs or being sliced
+        auto jobs = std::deque<job_t>{};         // in flight, in output order
+        if (geo_.budget) geo_.budget->charge(nt * gz_buffer);   // output buffer
         try {
-          auto raw_out = std::unique_ptr<char[]>(new char[nt * gz_buffer + 4096]);
+          raw_out.reset(new char[nt * gz_buffer + 4096]);
           auto out = (char*)(void*)((uintptr_t(raw_out.get()) + 4095) & ~4095);  // align to page size
           for (auto& strm : strms) {
-            zng_stream_init(strm);
+            zng_stream_init(strm, codec);
+          }
+          if (codec.kind == codec_t::zstd) {
+            for (auto& cctx : cctxs) {
+              if (nullptr == (cctx = ZSTD_createCCtx())) throw std::runtime_error("fastq::writer_t: not enough memory");
+            }
           }
+          if (!framed) dicts.resize(nt);
+          auto window = std::array<char, dict_size>{};    // tail of the member so far
+          size_t window_len = 0;
           uint32_t crc = zng_crc32(0L, nullptr, 0);
           uint64_t tot_bytes = 0;
-          auto prep_strm = [&](int idx, uint32_t avail_in, char* buf) -> unsigned {
-            auto tmp = std::min(avail_in, chunk_size);
-            auto& strm = strms[idx];
-            zng_stream_reset(strm);
-            strm.avail_in = tmp;
-            strm.next_in = (unsigned char*)buf + idx * chunk_size;
+          uint64_t member_bytes = 0;    // uncompressed bytes in current gzip member
+          auto write = [&](const char* buf, size_t n) {
+            gzout.write(buf, n);
+            pos_.file_bytes += n;
+            tot_gz_bytes_.store(pos_.file_bytes, std::memory_order_relaxed);
+          };
+          // adaptive: a round's (nt slices) level follows the fill level of the input queue.
+          // backlog -> faster, starving -> better ratio
+          int level = codec.adaptive() ? codec.max_level : codec.level;
+          const size_t high_water = std::max<size_t>(1, (3 * geo_.chunks) / 4);
+          const size_t low_water = geo_.chunks / 4;
+
+          // slices don't span buffers, but up to nt slices of any buffers are in flight,
+          // thus submitted buffers smaller than tot_chunk_size() keep all threads busy.
+          size_t njobs = 0;           // submitted
+          size_t nbufs = 0;           // popped, sequence number of bufs.back() + 1
+          size_t avail_in = 0;
+          char* next_in = nullptr;
+          bool member_end = false;    // bufs.back() ends the gzip member
+          bool last = false;
+          std::shared_ptr<std::promise<stream_pos_t>> sync;   // pending member boundary
+
+          auto submit_job = [&]() {
+            const size_t slot = njobs++ % nt;
+            if (slot == 0) {
+              if (codec.adaptive()) {
+                const auto fill = in_chunks_.size();
+                if (fill >= high_water) level = std::max(codec.level, level - 1);
+                else if (fill <= low_water) level = std::min(codec.max_level, level + 1);
+              }
+              level_.store(level, std::memory_order_relaxed);
+              level_sum_.fetch_add(level, std::memory_order_relaxed);
+              rounds_.fetch_add(1, std::memory_order_relaxed);
+            }
+            const auto len = std::min<size_t>(avail_in, chunk_size);
+            char* in = next_in;
+            next_in += len;
+            avail_in -= len;
+            auto& job = jobs.emplace_back(job_t{ .len = len, .buf = nbufs - 1 });
+            if (member_end && (avail_in == 0)) {
+              job.finish = true;
+              job.last = last;
+              job.sync = std::move(sync);
+              job.crc = crc;
+              job.member_bytes = member_bytes;
+              crc = zng_crc32(0L, nullptr, 0);    // the next member may be sliced before this one is written
+              member_bytes = 0;
+              member_end = false;
+            }
+            if (framed && (len == 0)) return;   // member boundary only
+            auto& strm = strms[slot];
+            zng_stream_reset(strm, codec, level);
+            strm.avail_in = static_cast<uint32_t>(len);
+            strm.next_in = (unsigned char*)in;
             strm.avail_out = gz_buffer;
-            strm.next_out = (unsigned char*)out + idx * gz_buffer;
-            strm.data_type = Z_SYNC_FLUSH;  // abuse, fixed later
-            return avail_in - tmp;
+            strm.next_out = (unsigned char*)out + slot * gz_buffer;
+            strm.data_type = job.finish ? Z_FINISH : Z_SYNC_FLUSH;  // abuse, fixed later
+            const char* dict = nullptr;
+            size_t dict_len = 0;
+            if (!framed) {
+              // priming: copy of the window, the next slices move it on
+              dict = dicts[slot].data();
+              dict_len = window_len;
+              std::memcpy(dicts[slot].data(), window.data(), window_len);
+              if (len >= dict_size) {
+                std::memcpy(window.data(), in + len - dict_size, dict_size);
+                window_len = dict_size;
+              }
+              else {
+                const auto keep = std::min(window_len, dict_size - len);
+                std::memmove(window.data(), window.data() + window_len - keep, keep);
+                std::memcpy(window.data() + keep, in, len);
+                window_len = keep + len;
+              }
+              if (job.finish) window_len = 0;    // next member starts from scratch
+            }
+            job.f = pool->async([this, &codec, gz_buffer, level, dict, dict_len, done = &job.done](zng_stream* strm, ZSTD_CCtx* cctx) {
+              HAHI_TRACE_SCOPE("deflate");
+              struct signal_t { writer_t* w; bool* done; ~signal_t() { w->signal(done); } } _{ this, done };
+              const auto t0 = std::chrono::steady_clock::now();
+              const auto out = (char*)strm->next_out;
+              const auto in = (const char*)strm->next_in;
+              auto slice = [&]() {
+                switch (codec.kind) {
+                  case codec_t::bgzf: {
+                    auto [size, crc] = bgzf::compress(*strm, in, strm->avail_in, out);
+                    return slice_t{ out, size, crc };
+                  }
+                  case codec_t::zstd: {
+                    const auto crc = static_cast<uint32_t>(zng_crc32(0L, (const unsigned char*)in, strm->avail_in));
+                    return slice_t{ out, zstd::compress(cctx, codec.zstd_level(level), in, strm->avail_in, out, gz_buffer), crc };
+                  }
+                  default: {
+                    const int flush = std::exchange(strm->data_type, 2);  // fix abuse
+                    if (dict_len && (Z_OK != zng_deflateSetDictionary(strm, (const unsigned char*)dict, static_cast<uint32_t>(dict_len)))) {
+                      throw std::runtime_error("fastq::writer_t: failed to prime deflate stream");
+                    }
+                    zng_deflate(strm, flush);
+                    assert(strm->avail_in == 0);   // all input consumed
+                    return slice_t{ out, gz_buffer - strm->avail_out, 0 };
+                  }
+                }
+              }();
+              deflate_time_.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+              return slice;
+            }, &strm, cctxs[slot]);
           };
-          for (bool last = false; !last;) {
-            auto buf = in_chunks_.pop();
-            tot_bytes += buf.size();
-            tot_bytes_written_.store(tot_bytes, std::memory_order_relaxed);
-            // allocate work to compress threads
-            auto avail_in = static_cast<uint32_t>(buf.size());
-            last = avail_in < tot_chunk_size();    // stop condition
-            int nct = 0;  // used threads
-            do  {
-              avail_in = prep_strm(nct++, avail_in, buf.data());
-            } while (avail_in);
-            if (last) strms[nct - 1].data_type = Z_FINISH;  // abuse, fixed later
-            cf.clear();
-            for (auto j = 0; j < nct; ++j) {
-              cf.emplace_back(
-                pool->async([](zng_stream* strm) {
-                  const auto out = strm->next_out;
-                  const int flush = std::exchange(strm->data_type, 2);  // fix abuse
-                  zng_deflate(strm, flush);
-                  assert(strm->avail_in == 0);   // all input consumed
-                  return std::pair<char*, uint32_t>{ (char*)out, strm->avail_out };
-                }, &strms[j])
-              );
+
+          auto computed = [&](const job_t& job) {
+            std::lock_guard<std::mutex> _(event_mutex_);
+            return !job.f.valid() || job.done;
+          };
+
+          // writes oldest job, releases input no job refers to anymore
+          auto write_job = [&]() {
+            auto& job = jobs.front();
+            if (job.f.valid()) {
+              auto slice = job.f.get();
+              HAHI_TRACE_SCOPE("write");
+              write(slice.out, slice.size);
+              if (framed) {
+                pos_.crc = zng_crc32_combine(pos_.crc, slice.crc, job.len);
+                pos_.bytes += job.len;
+              }
+            }
+            if (job.finish) {
+              if (framed) {
+                // frames are complete, bgzf: end-of-file marker
+                if (job.last && (codec.kind == codec_t::bgzf)) write(bgzf::eof_block, bgzf::eof_block_size);
+              }
+              else {
+                // write 8 byte gz footer (little endian)
+                const uint32_t gzcrc = htogz(job.crc);
+                const uint64_t gzbytes = htogz(job.member_bytes);
+                write((const char*)&gzcrc, 4);
+                write((const char*)&gzbytes, 4);
+                pos_.crc = zng_crc32_combine(pos_.crc, job.crc, job.member_bytes);
+                pos_.bytes += job.member_bytes;
+              }
+              if (job.sync) {
+                gzout.flush();
+                job.sync->set_value(pos_);
+                if (!framed) {
+                  // start next member
+                  write(gz_header, sizeof(gz_header) - 1);
+                }
+              }
+            }
+            {
+              HAHI_TRACE_SCOPE("flush");
+              gzout.flush();
             }
-            crc = zng_crc32(crc, (unsigned char*)buf.data(), buf.size());
-            for (auto j = 0; j < nct; ++j) {
-              // write deflate chunks in order
-              auto [cout, avail] = cf[j].get();
-              gzout.write((const char*)cout, gz_buffer - avail);
+            jobs.pop_front();
+            // buffers before the oldest job's and, if sliced up, the current one
+            const size_t in_use = !jobs.empty() ? jobs.front().buf : (avail_in || member_end) ? nbufs - 1 : nbufs;
+            while (!bufs.empty() && (nbufs - bufs.size() < in_use)) {
+              release(bufs.front());
+              bufs.pop_front();
             }
-            gzout.flush();
+          };
+
+          while (!(last && (avail_in == 0) && !member_end && jobs.empty())) {
+            if (jobs.size() < nt) {
+              if (avail_in || member_end) {
+                submit_job();
+                continue;
+              }
+              if (!last) {
+                // blocks only if nothing is in flight
+                const auto seen = events();
+                auto in = jobs.empty() ? std::optional<in_chunk_t>{ in_chunks_.pop() } : in_chunks_.try_pop();
+                if (in) {
+                  auto& buf = bufs.emplace_back(std::move(*in));
+                  ++nbufs;
+                  last = buf.last;    // stop condition
+                  sync = std::move(buf.sync);
+                  member_end = last || sync;
+                  tot_bytes += buf.buf.size();
+                  member_bytes += buf.buf.size();
+                  tot_bytes_written_.store(tot_bytes, std::memory_order_relaxed);
+                  if (!framed) crc = zng_crc32(crc, (unsigned char*)buf.buf.data(), buf.buf.size());   // framed: per slice
+                  avail_in = buf.buf.size();
+                  next_in = buf.buf.data();
+                  continue;
+                }
+                // starving, but slices in flight: write what's done, else wait for a slice or input
+                if (!computed(jobs.front())) {
+                  wait_event(seen);
+                  continue;
+                }
+              }
+            }
+            write_job();
           }
-          // write 8 byte gz footer (little endian)
-          crc = htogz(crc);
-          tot_bytes = htogz(tot_bytes);
-          gzout.write((const char*)&crc, 4);
-          gzout.write((const char*)&tot_bytes, 4);
           tot_bytes_written_.store(tot_bytes, std::memory_order_release);
         }
         catch (...) {
           eptr_ = std::current_exception();
+          if (geo_.budget) geo_.budget->notify();
+        }
+        for (auto& job : jobs) {
+          if (job.f.valid()) job.f.wait();    // running jobs reference streams, buffers and output
         }
         for (auto& strm : strms) (void)zng_deflateEnd(&strm);
+        for (auto* cctx : cctxs) ZSTD_freeCCtx(cctx);
+        if (geo_.budget) geo_.budget->release(nt * gz_buffer);
         gzout.close();
       });
     }
 
+    // uncompressed output, e.g. into a pipe to an aligner.
+    // submitted buffers are written as they are, no pool jobs.
+    void launch_passthrough(bool append) {
+      FILE* out = (output_ == "-") ? stdout : std::fopen(output_.string().c_str(), append ? "ab" : "wb");
+      if (!out) throw std::runtime_error(std::string("fastq::writer_t: failed to open output file \'") + output_.string() + '\'');
+      std::setvbuf(out, nullptr, _IONBF, 0);    // whole buffers, no extra copy
+#ifdef FASTQ_LINUX
+      (void)::fcntl(fileno(out), F_SETPIPE_SZ, 1 << 20);   // fewer wake-ups of the reader, fails for non-pipes
+#endif
+      compressor_ = std::thread([this, out]() {
+        HAHI_TRACE_THREAD("writer " + output_.filename().string());
+        try {
+          for (bool last = false; !last;) {
+            auto in = in_chunks_.pop();
+            last = in.last;
+            {
+              HAHI_TRACE_SCOPE("write");
+              if (in.buf.size() != std::fwrite(in.buf.data(), 1, in.buf.size(), out)) {
+                throw std::runtime_error(std::string("fastq::writer_t: failed to write \'") + output_.string() + '\'');
+              }
+            }
+            pos_.crc = zng_crc32(pos_.crc, (const unsigned char*)in.buf.data(), in.buf.size());
+            pos_.bytes += in.buf.size();
+            pos_.file_bytes += in.buf.size();
+            release(in);
+            tot_bytes_written_.store(pos_.bytes, std::memory_order_relaxed);
+            tot_gz_bytes_.store(pos_.file_bytes, std::memory_order_relaxed);
+            if (in.sync) {
+              std::fflush(out);
+              in.sync->set_value(pos_);
+            }
+          }
+          tot_bytes_written_.store(pos_.bytes, std::memory_order_release);
+        }
+        catch (...) {
+          eptr_ = std::current_exception();
+          if (geo_.budget) geo_.budget->notify();
+        }
+        (out == stdout) ? std::fflush(out) : std::fclose(out);
+      });
+    }
+
     template <typename T> 
     using queue_t = hahi::concurrent_queue<T>;
-    using buffer_t = std::string;
 
-    buffer_t in_chunk_;              // current input buffer used by put functions
-    queue_t<buffer_t> in_chunks_;    // populated by put functions, consumed by compress thread
+    struct in_chunk_t {
+      buffer_t buf;
+      bool last = false;    // last chunk, finishes the stream
+      std::shared_ptr<std::promise<stream_pos_t>> sync = nullptr;   // finishes the gzip member
+      bool spare = false;   // put()-buffer, recycled after use
+    };
+
+    // put()-buffers return to the producer instead of being freed and regrown.
+    // few spares suffice: the producer fills one buffer per compression round.
+    // submitted buffers are owned by the caller's allocation pattern, not recycled.
+    static constexpr size_t max_spares = 2;
+
+    buffer_t in_chunk_;               // current input buffer used by put functions
+    std::vector<buffer_t> spares_;    // free list, producer <-> compressor
+    hahi::spin_lock spare_mutex_;
+    queue_t<in_chunk_t> in_chunks_;   // populated by put/submit functions, consumed by compress thread
+    std::mutex event_mutex_;          // input queued or slice computed
+    std::condition_variable event_cv_;
+    uint64_t events_ = 0;
+    const geometry_t geo_;
     std::exception_ptr eptr_;
     bool closed_ = true;
     unsigned num_threads_ = 0;
     std::shared_ptr<hahi::pool_t> shpool_;
     std::atomic<size_t> tot_bytes_written_ = 0;
+    std::atomic<size_t> tot_gz_bytes_ = 0;
+    std::atomic<int> level_ = geo_.codec.adaptive() ? geo_.codec.max_level : geo_.codec.level;
+    std::atomic<int64_t> level_sum_ = 0;
+    std::atomic<size_t> rounds_ = 0;
+    std::atomic<int64_t> deflate_time_ = 0;   // ns
+    stream_pos_t pos_;                // compressor thread
     std::thread compressor_;
     const std::filesystem::path output_;
   };
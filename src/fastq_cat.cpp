@@ -4,6 +4,7 @@
 #include <charconv>
 #include <array>
 #include <memory>
+#include <optional>
 #include <chrono>
 #include <fastq/reader.hpp>
 #include <fastq/splitter.hpp>
@@ -16,9 +17,13 @@ Concatenate ranges from fastq[.gz] files.
 With no FILE, or when FILE is -, read standard input.
 
   -f: force overwrite of output file.
+  --bgzf: BGZF compressed output (blocked gzip, as bgzip), same as -c bgzf.
+  -c <codec>: output codec <gzip|bgzf|zstd>[:<level>|:<min>-<max>][:<deflate strategy>] or none
+    Ex: -c gzip:1; -c zstd:19; -c gzip:1-9 (adaptive level).
+    Default: by -o, '-' or named pipe: none, .zst: zstd, gzip otherwise.
   -m <mssk>: only output unmasked lines (max. 64Bit)
     Ex: -m 0010, outputs 2nd line of every 4-line block.
-  -o <FILE>: compressed output file
+  -o <FILE>: output file, '-': standard output
     If not given, writes uncompressed to standard output.
   -r <line range>: only output lines in given range.
     Ex: -r 0-10; -r 10:3
@@ -79,12 +84,15 @@ class cout_writer {
 
 public:
   void puts(fastq::str_view str) {
-    if (std::cin.good()) {
-      std::fwrite(str.data(), 1, str.length(), stdout);
-      std::fputc('\n', stdout);
-      tot_bytes_ += str.length() + 1;
-    }
+    std::fwrite(str.data(), 1, str.length(), stdout);
+    std::fputc('\n', stdout);
+    tot_bytes_ += str.length() + 1;
+  }
+  void submit(std::string&& buf) {
+    std::fwrite(buf.data(), 1, buf.length(), stdout);
+    tot_bytes_ += buf.length();
   }
+  unsigned tot_chunk_size() const noexcept { return 1024 * 1024; }
   auto tot_bytes() const { return tot_bytes_; }
 };
 
@@ -105,19 +113,29 @@ void cp(Splitter&& splitter,
     splitter();
     ++lines_in;
   }
+  // render into whole blocks, handed over to the writer
+  auto blk = std::string{};
+  blk.reserve(writer->tot_chunk_size());
   auto m = mask;
   for (size_t i = range.first; !splitter.eof() && (i < range.second); ++i) {
     auto line = splitter();
+    if (splitter.eof() && line.empty()) break;    // stdin: getline past the last line
     ++lines_in;
     if (m.first & 1) {
       ++lines_out;
-      writer->puts(line);
+      if (blk.size() + line.length() >= writer->tot_chunk_size()) {
+        writer->submit(std::move(blk));
+        blk = std::string{};
+        blk.reserve(writer->tot_chunk_size());
+      }
+      blk.append(line).push_back('\n');
     }
     m.first >>= 1;
     if (--m.second == 0) {
       m = mask;
     }
   }
+  writer->submit(std::move(blk));
   bytes_in += splitter.tot_bytes();
   bytes_out += writer->tot_bytes();
 }
@@ -132,6 +150,8 @@ int main(int argc, const char* argv[]) {
     std::pair<uint64_t, int> mask{-1, 64};
     std::vector<std::filesystem::path> files;
     std::filesystem::path output;
+    auto geo = fastq::writer_t<>::geometry_t{};
+    std::optional<fastq::codec_t> codec;
     int i = 1;
     while (i < argc) {
       if (0 == std::strcmp(argv[i], "-h") * std::strcmp(argv[i], "--help")) {
@@ -143,6 +163,12 @@ int main(int argc, const char* argv[]) {
       else if (0 == std::strcmp(argv[i], "-v")) {
         verbose = true;
       }
+      else if (0 == std::strcmp(argv[i], "--bgzf")) {
+        codec = fastq::codec_t{ fastq::codec_t::bgzf };
+      }
+      else if (0 == std::strcmp(argv[i], "-c")) {
+        codec = fastq::codec_t::parse((++i < argc) ? argv[i] : "");
+      }
       else if (0 == std::strcmp(argv[i], "-r")) {
         range = parse_range((++i < argc) ? argv[i] : "");
       }
@@ -172,14 +198,17 @@ int main(int argc, const char* argv[]) {
     if (std::filesystem::exists(output) && !force) {
       throw "output file exists, consider -f";
     }
+    geo.codec = codec.value_or(fastq::codec_t::from_path(output));
     auto t0 = std::chrono::high_resolution_clock::now();
     if (!output.empty()) {
       gPool.reset( new hahi::pool_t{} );
-      auto writer = std::make_unique<fastq::writer_t<>>(output, gPool);
+      auto writer = std::make_unique<fastq::writer_t<>>(output, gPool, unsigned(-1), fastq::stream_pos_t{}, geo);
       for (auto& file: files) {
         file.empty() ? cp(cin_splitter{}, writer.get(), range, mask)
                      : cp(fastq::line_splitter<>{file}, writer.get(), range, mask);
       }
+      writer->close(true);
+      if (writer->failed()) throw "failed to write output file";
     }
     else {
       auto writer = std::make_unique<cout_writer>();
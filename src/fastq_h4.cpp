@@ -1,15 +1,27 @@
 #include <cstdlib>
+#include <csignal>
 #include <charconv>
 #include <iostream>
 #include <filesystem>
 #include <algorithm>
+#include <array>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 #include <fastq/barcode.hpp>
 #include <fastq/reader.hpp>
 #include <fastq/splitter.hpp>
 #include <fastq/writer.hpp>
+#include <fastq/demux_writer.hpp>
 #include <fastq/fuzzy_matching.hpp>
+#include <fastq/bam.hpp>
+#include <fastq/layout.hpp>
 #include "device/pool.hpp"
+#include "device/reorder.hpp"
+#include "device/budget.hpp"
+#include "device/trace.hpp"
 
 
 constexpr char usage_msg[] = R"(Usage: fastq_h4 JSON_FILE [OPTIONS]...
@@ -19,6 +31,20 @@ constexpr char usage_msg[] = R"(Usage: fastq_h4 JSON_FILE [OPTIONS]...
   --replace '{"json_pointer": value}'.
     Ex: --replace '{"/range": "0-1000"}' --replace '{"/barcode/plate/file": "Plate_BC_7.txt"}'
   --dry: dry-run.
+  --stats: stats-only run, writes barcode statistics but no reads.
+  --resume: resume from checkpoint in output directory.
+  --shard i/N: process i-th of N balanced parts of the range (0 <= i < N).
+    writes into subdirectory shard_i of the output directory, see fastq_merge.
+    an open-ended range costs every shard a full pass over /reads/R1 (read count),
+    prefer a closed range, e.g. --replace '{"/range": "0-<reads>"}'.
+  --trace FILE: writes Chrome trace of the pipeline stages (requires -DHAHI_TRACE build).
+  --autotune: tunes buffer geometry on a sample of the range before the run.
+  --mem MB: memory budget of the in-flight data, overrides /tuning/memory_mb.
+  --bench MODE[,MODE...]: runs the range once per mode (and pool size), prints
+    one json line per run. MODE: full or '+'-separated no-op stages
+    mem-input (pre-decompressed input), identity-match, null-writer.
+    Ex: --bench full,null-writer,mem-input+null-writer
+  --bench-threads N[,N...]: pool sizes for --bench, default: pool_threads.
 )";
 
 
@@ -33,6 +59,11 @@ using Splitter = fastq::seq_field_splitter<0b1111>;
 std::shared_ptr<hahi::pool_t> gPool;
 
 
+// set by SIGTERM, triggers checkpoint
+volatile std::sig_atomic_t gTerm = 0;
+extern "C" void on_sigterm(int) { gTerm = 1; }
+
+
 // hacky way replaces leadiing "~/" in path with the path to HOME 
 fs::path expand_home(const fs::path& path) {
   // this is a bit hacky
@@ -65,25 +96,109 @@ std::pair<size_t, size_t> parse_range(std::string_view str) {
 }
 
 
+// parse "--shard" value "i/N"
+std::pair<size_t, size_t> parse_shard(std::string_view str) {
+  size_t i = 0, N = 0;
+  auto [p0, ec0] = std::from_chars(str.begin(), str.end(), i);
+  if ((ec0 != std::errc{}) || (p0 == str.end()) || (*p0 != '/')) throw "can't parse shard";
+  auto [p1, ec1] = std::from_chars(p0 + 1, str.end(), N);
+  if ((ec1 != std::errc{}) || (p1 != str.end()) || (i >= N)) throw "invalid shard";
+  return { i, N };
+}
+
+
+// number of reads in fastq[.gz|.zst] file
+size_t count_reads(const fs::path& path) {
+  auto in = fastq::infile_t(path, 1 << 20);
+  auto buf = std::vector<char>(1 << 20);
+  size_t lines = 0;
+  int n = 0;
+  while (0 < (n = in.read(buf.data(), static_cast<unsigned>(buf.size())))) {
+    lines += std::count(buf.data(), buf.data() + n, '\n');
+  }
+  if (n < 0) throw std::runtime_error("error reading " + path.string());
+  return lines / 4;
+}
+
+
+namespace fastq {
+
+  void to_json(json& j, const stream_pos_t& pos) {
+    j = json{ { "size", pos.file_bytes }, { "bytes", pos.bytes }, { "crc32", pos.crc } };
+  }
+
+  void from_json(const json& j, stream_pos_t& pos) {
+    j.at("size").get_to(pos.file_bytes);
+    j.at("bytes").get_to(pos.bytes);
+    j.at("crc32").get_to(pos.crc);
+  }
+
+}
+
+
 // give reads a name...
 enum ReadIdx {
-  R1_, R2_, R3_, R4_, I1_
+  R1_, R2_, R3_, R4_, I1_, 
+  RX_     // concatenated H4::rx_reads, matching only
 };
+constexpr const char* read_names[] = { "R1", "R2", "R3", "R4", "I1", "RX" };
 
 
 #define optional_json(expr) try { expr; } catch (json::exception&) {}
 
 
+// --bench: pipeline stages replaced by no-ops
+struct bench_t {
+  bool mem_input = false;         // pre-decompressed input served from memory
+  bool identity_match = false;    // no matching, all barcodes invalid
+  bool null_writer = false;       // rendered blocks are dropped, no compression
+  std::array<std::shared_ptr<const std::string>, 5> input;   // mem_input, by ReadIdx
+
+  // "full" or '+'-separated list of the above, e.g. "mem-input+null-writer"
+  static bench_t parse(std::string_view spec) {
+    auto bench = bench_t{};
+    if (spec == "full") return bench;
+    while (!spec.empty()) {
+      const auto plus = spec.find('+');
+      const auto tok = spec.substr(0, plus);
+      spec.remove_prefix((plus == spec.npos) ? spec.size() : plus + 1);
+      if (tok == "mem-input") bench.mem_input = true;
+      else if (tok == "identity-match") bench.identity_match = true;
+      else if (tok == "null-writer") bench.null_writer = true;
+      else throw std::runtime_error("--bench: unknown mode '" + std::string(tok) + "', expected full, mem-input, identity-match or null-writer");
+    }
+    return bench;
+  }
+};
+
+
 struct H4 {
   using blks_t = std::vector<Splitter::blk_type>; 
-  static constexpr size_t blk_size = 10000;   // non-sensitive tuneable
+  using reader_geometry_t = fastq::reader_t::geometry_t;
+  using writer_geometry_t = fastq::writer_t<>::geometry_t;
 
-  explicit H4(const json& Jin, bool verbose) : verbose(verbose), J(Jin) {
+  explicit H4(const json& Jin, bool verbose, const bench_t& bench = {}) : verbose(verbose), bench(bench), J(Jin) {
     range = parse_range(J.at("range").get<std::string>());
     if (range.first >= range.second) throw "invalid range";
+    range_begin = range.first;
+    optional_json(checkpoint_interval = std::chrono::seconds(J.at("checkpoint").get<unsigned>()));
+
+    // buffer geometry, optional
+    optional_json(blk_size = J.at("/tuning/blk_size"_json_pointer).get<size_t>());
+    optional_json(reader_geo.chunk_size = J.at("/tuning/reader/chunk_size"_json_pointer).get<size_t>());
+    optional_json(reader_geo.chunks = J.at("/tuning/reader/chunks"_json_pointer).get<unsigned>());
+    optional_json(reader_geo.gz_buffer = J.at("/tuning/reader/gz_buffer"_json_pointer).get<unsigned>());
+    optional_json(writer_geo.chunk_size = J.at("/tuning/writer/chunk_size"_json_pointer).get<unsigned>());
+    optional_json(writer_geo.chunks = J.at("/tuning/writer/chunks"_json_pointer).get<unsigned>());
+    if (blk_size == 0) throw "invalid tuning/blk_size";
+    optional_json(memory_mb = J.at("/tuning/memory_mb"_json_pointer).get<size_t>());
+    budget = std::make_shared<hahi::budget_t>(memory_mb << 20);    // 0: bookkeeping only
+    reader_geo.budget = writer_geo.budget = budget;
 
     // create thread pool
-    gPool.reset( new hahi::pool_t(J.at("pool_threads").get<unsigned>()));
+    bool pin = false;
+    optional_json(pin = J.at("pin_threads").get<bool>());
+    gPool.reset( new hahi::pool_t(J.at("pool_threads").get<unsigned>(), pin));
 
     // barcodes
     auto jbc = J.at("barcodes");
@@ -105,31 +220,112 @@ struct H4 {
       plate = gen_bc("plate");
     }
     stagger = gen_bc("stagger");
+    // correctability analysis, one job per set
+    const auto bcs = { &bc_A, &bc_B, &bc_C, &bc_D, &plate, &stagger };
+    auto analysis = std::vector<std::future<fastq::correctability_t>>{};
+    for (auto* bc : bcs) {
+      analysis.emplace_back(gPool->async([bc]() { return fastq::analyse_barcode(*bc); }));
+    }
+    auto ait = analysis.begin();
+    for (auto* bc : bcs) {
+      bc->select_matcher((ait++)->get());
+      if (bc->size() > 0xFFF) throw "barcode set exceeds 4095 codes";   // h4_stats_t::pack
+    }
 
     // reads
     auto jr = J.at("reads");
     gz_root = expand_home(jr.at("root").get<std::string>());
-    R1 = Splitter{gz_root / jr.at("R1").get<std::string>()};
-    R2 = Splitter{gz_root / jr.at("R2").get<std::string>()};
-    R3 = Splitter{gz_root / jr.at("R3").get<std::string>()};
-    R4 = Splitter{gz_root / jr.at("R4").get<std::string>()};
+    R1 = Splitter{gz_root / jr.at("R1").get<std::string>(), reader_geo, bench.input[R1_]};
+    R2 = Splitter{gz_root / jr.at("R2").get<std::string>(), reader_geo, bench.input[R2_]};
+    R3 = Splitter{gz_root / jr.at("R3").get<std::string>(), reader_geo, bench.input[R3_]};
+    R4 = Splitter{gz_root / jr.at("R4").get<std::string>(), reader_geo, bench.input[R4_]};
     if (!plate.empty()) {
-      I1 = Splitter{gz_root / jr.at("I1").get<std::string>()};
+      I1 = Splitter{gz_root / jr.at("I1").get<std::string>(), reader_geo, bench.input[I1_]};
     }
+    parse_layout();
     // output
     auto jout = J.at("output"); 
     r1_out = !jout.at("R1").get<std::string>().empty();  
     clipping = !jout.at("R2").get<std::string>().empty();
     out_root = expand_home(jout.at("root").get<std::string>());
+    optional_json(demux = jout.at("demux").get<std::string>());
+    optional_json(ubam = jout.at("ubam").get<std::string>());
+    optional_json(interleaved = jout.at("interleaved").get<bool>());
+    // codecs: by suffix, "bgzf": true or "codec": "<spec>" | { "R1": "<spec>", "R2": ..., "ubam": ... }
+    auto codec = [&](const char* L, fastq::codec_t def) {
+      optional_json(def = fastq::codec_t::from_path(output_path(jout.at(L).get<std::string>())));
+      if (jout.value("bgzf", false)) def.kind = fastq::codec_t::bgzf;
+      auto spec = std::string{};
+      optional_json(spec = jout.at("codec").get<std::string>());
+      optional_json(spec = jout.at("codec").at(L).get<std::string>());
+      return spec.empty() ? def : fastq::codec_t::parse(spec);
+    };
+    R1_codec = codec("R1", {});
+    R2_codec = codec("R2", {});
+    BAM_codec = codec("ubam", { fastq::codec_t::bgzf });
+    BAM_codec.kind = fastq::codec_t::bgzf;    // BAM is BGZF by definition
+    if (!ubam.empty() && !demux.empty()) throw "uBAM output doesn't support demux";
+    if (interleaved && !(r1_out && clipping && demux.empty())) throw "interleaved output requires R1 and R2 and no demux";
+    if (streams() && !demux.empty()) throw "demux doesn't support stdout or named pipe outputs";
+    auto std_outs = 0;
+    for (const char* L : { "R1", "R2", "ubam" }) {
+      optional_json(std_outs += (jout.at(L).get<std::string>() == "-"));
+    }
+    if (interleaved) std_outs -= (jout.at("R2").get<std::string>() == "-");   // no R2 writer
+    if (std_outs > 1) throw "more than one output to stdout, consider /output/interleaved";
+    if (!demux.empty()) {
+      if (demux == "plate") {
+        if (!has_plate()) throw "demux by plate requires plate barcodes";
+        demux_sets = { &plate };
+      }
+      else if (std::string_view(bx_order).starts_with(demux)) {
+        // BX prefix, see /layout/bx
+        for (char L : demux) demux_sets.push_back(&bc(L));
+      }
+      else {
+        throw std::runtime_error("invalid demux mode, expected \"plate\" or a prefix of BX order \"" + bx_order + '"');
+      }
+      optional_json(demux_max_open = jout.at("demux_max_open").get<size_t>());
+      if (demux_max_open == 0) throw "demux_max_open shall be positive";
+      for (unsigned i = 0; i < gPool->num_threads(); ++i) demux_cs.emplace_back(new demux_writer_t::compressor_t{});
+    }
+  }
+
+  fastq::barcode_t& bc(char L) {
+    switch (L) {
+      case 'A': return bc_A;
+      case 'B': return bc_B;
+      case 'C': return bc_C;
+      default: return bc_D;
+    }
   }
 
   bool has_stagger() const noexcept { return !stagger.empty(); }
   bool has_plate() const noexcept { return !plate.empty(); }
 
+  // "-": stdout, absolute paths (e.g. named pipes) as given
+  fs::path output_path(const std::string& file) const {
+    return (file == "-") ? fs::path("-") : out_root / file;
+  }
+
+  // any output to stdout or a named pipe
+  bool streams() const {
+    auto ec = std::error_code{};
+    for (const char* L : { "R1", "R2", "ubam" }) {
+      auto file = std::string{};
+      optional_json(file = J.at("output").at(L).get<std::string>());
+      if (!file.empty() && ((file == "-") || fs::is_fifo(output_path(file), ec))) return true;
+    }
+    return false;
+  }
+
   void dry_run() {
     using std::cout;
     cout << "range: " << range.first << '-' << range.second << '\n';
-    cout << "pool_threads: " << gPool->num_threads() << '\n';
+    cout << "pool_threads: " << gPool->num_threads() << " of " << hahi::affinity::concurrency() << " available";
+    if (gPool->pinned()) cout << ", pinned to " << gPool->num_nodes() << " NUMA node(s)";
+    cout << '\n';
+    cout << "tuning: " << tuning().dump() << '\n';
     auto bc_stats = [](const char* name, const auto& bc) { 
       cout << name << "  ";
       if (bc.empty()) {
@@ -141,6 +337,14 @@ struct H4 {
           << '[' << bc.min_code_length() << ", " << bc.max_code_length() << "]  "
           << bc.path()
           << '\n';
+      const auto& ca = bc.correctability();
+      cout << "                min_ed: " << ca.min_ed 
+           << "  pairs: " << ca.min_ed_pairs
+           << "  duplicates: " << ca.duplicates
+           << "  collisions: " << ca.collisions
+           << "  radius: " << ca.radius()
+           << "  matcher: " << fastq::matcher_name(bc.matcher())
+           << '\n';
     };
     cout << "barcodes\n";
     bc_stats("    bc_A:   ", bc_A);
@@ -162,28 +366,53 @@ struct H4 {
     gz_stats("    R4:", R4);
     gz_stats("    I1:", I1);
 
-    cout << "matches\n";
-    if (has_stagger()) {
-      std::cout << "    stagger <- idx min_ed(R2[1](0:" << stagger.min_code_length() << "), stagger)\n";
-    }
-    const auto ctl = bc_D.max_code_length()
-                  + 1
-                  + bc_B.max_code_length()
-                  + bc_A.max_code_length()
-                  + 1
-                  + bc_C.max_code_length();
-    cout << "    code_total_length:  " << ctl << '\n';
+    cout << "layout\n";
+    cout << "    RX:";
+    for (auto r : rx_reads) cout << ' ' << read_names[r];
+    cout << '\n';
+    for (const auto& seg : layout) {
+      cout << "    " << std::left << std::setw(8) << seg.name << "<- " << read_names[seg.read] 
+           << "[" << seg.offset.src << ", +" << seg.length.src << ']' 
+           << (seg.is_static() ? "  static" : "") << '\n';
+    }
+    cout << "    clip:   R4[" << clip.src << ", ...]\n";
+    cout << "    BX:     " << bx_order << (has_plate() ? "-plate\n" : "\n");
     cout << "output\n";
-    cout << "    R1: " << (r1_out ? out_root / J.at("/output/R1"_json_pointer).get<std::string>() : "NA") << '\n';
-    cout << "    R2: " << (clipping ? out_root / J.at("/output/R2"_json_pointer).get<std::string>() : "NA (no clipping)") << '\n';
+    cout << "    R1: " << (r1_out ? output_path(J.at("/output/R1"_json_pointer).get<std::string>()) : "NA") << (r1_out ? "  (" + R1_codec.str() + ')' : "") << '\n';
+    if (interleaved) {
+      cout << "    R2: interleaved into R1\n";
+    }
+    else {
+      cout << "    R2: " << (clipping ? output_path(J.at("/output/R2"_json_pointer).get<std::string>()) : "NA (no clipping)") << (clipping ? "  (" + R2_codec.str() + ')' : "") << '\n';
+    }
+    if (!ubam.empty()) {
+      cout << "    uBAM: " << output_path(ubam) << "  (" << BAM_codec.str() << ")\n";
+    }
+    if (!demux.empty()) {
+      size_t samples = 1;
+      for (auto* bc : demux_sets) samples *= bc->size();
+      cout << "    demux: " << demux << "  (max. " << samples << " samples)\n";
+    }
   }
 
   // feeding the work pipeline
   template <bool has_plate>
   void run() {
-    // layzy creation of writers
-    if (r1_out) R1_out.reset(new fastq::writer_t<>{out_root / J.at("/output/R1"_json_pointer).get<std::string>(), gPool});
-    if (clipping) R2_out.reset(new fastq::writer_t<>{out_root / J.at("/output/R2"_json_pointer).get<std::string>(), gPool});
+    // layzy creation of writers, per-sample writers are created on demand
+    if (demux.empty() && !stats_only && !bench.null_writer) {
+      auto file = [&](const char* L) { return J.at("output").at(L).get<std::string>(); };
+      auto geo = [&](const fastq::codec_t& codec) { auto geo = writer_geo; geo.codec = codec; return geo; };
+      if (r1_out) R1_out.reset(new fastq::writer_t<>{output_path(file("R1")), gPool, unsigned(-1), append_at(file("R1")), geo(R1_codec)});
+      if (clipping && !interleaved) R2_out.reset(new fastq::writer_t<>{output_path(file("R2")), gPool, unsigned(-1), append_at(file("R2")), geo(R2_codec)});
+      if (!ubam.empty()) {
+        const auto pos = append_at(ubam);
+        BAM_out.reset(new fastq::writer_t<>{output_path(ubam), gPool, unsigned(-1), pos, geo(BAM_codec)});
+        if (pos.file_bytes == size_t(-1)) {
+          BAM_out->submit(fastq::bam::header("@HD\tVN:1.6\tSO:unsorted\n@PG\tID:fastq_h4\tPN:fastq_h4\n"));
+        }
+      }
+    }
+    if (!stats_only) std::signal(SIGTERM, on_sigterm);
     
     std::vector<Splitter*> RS = { &R1, &R2, &R3, &R4 };
     if constexpr (has_plate) RS.push_back(&I1);
@@ -198,46 +427,123 @@ struct H4 {
     }
     if (i != range.first) throw "range exceeds number of reads";
 
-    auto match_queue = std::deque<std::future<h4_matches_t>>{};
+    // ordered completion queue, workers put rendered blocks, 
+    // consumer hands them to the writers in order
+    auto rob = hahi::reorder_buffer<h4_block_t>{std::max(4u, 2 * gPool->num_threads())};
+    std::exception_ptr consumer_eptr;
+    std::atomic<bool> stop = false;   // checkpointed on SIGTERM
+    std::atomic<size_t> written = range.first;    // records handed to the writers
+    auto monitor = telemetry_t{*this, RS, written};
+    auto consumer = std::jthread([&]() {
+      HAHI_TRACE_THREAD("consumer");
+      auto last_checkpoint = std::chrono::steady_clock::now();
+      for (;;) {
+        try {
+          auto blk = rob.pop();   // blocks until next in-order block is ready
+          if (!blk) break;        // closed and drained
+          budget->release(blk->bytes);    // the writers draw on their own
+          if (consumer_eptr || stop) continue;
+          written += blk->reads;
+          write_block(std::move(*blk));
+          if (stats_only) continue;
+          const auto now = std::chrono::steady_clock::now();
+          if (gTerm || (checkpoint_interval.count() && (now - last_checkpoint >= checkpoint_interval))) {
+            write_checkpoint(written);
+            last_checkpoint = now;
+            if (gTerm) stop = true;
+          }
+        }
+        catch (...) {
+          // keep draining, producer must not dead-lock
+          if (!consumer_eptr) consumer_eptr = std::current_exception();
+          budget->notify();
+        }
+      }
+    });
+    struct close_guard { const decltype(rob)& r; ~close_guard() { r.close(); } } _{rob};   // exception safety
     bool any_eof = false;
-    for (; !any_eof && (i < range.second); i += blk_size) {
+    for (; !any_eof && !stop && (i < range.second); i += blk_size) {
+      // backpressure: no new block while the budget is exhausted, 
+      // unless there is nothing in flight that could free memory
+      budget->wait([&]() { return rob.size() == 0; });
       // collect block of reads
       auto blks = blks_t{};
       const auto n = std::min(range.second - i, blk_size);  // sequences to read
-      for (auto* R : RS) {
-        blks.emplace_back(R->operator()(n));
-        any_eof |= R->eof();
+      {
+        auto _ = stage_timer_t{stage_time_[split_stage]};
+        for (auto* R : RS) {
+          HAHI_TRACE_SCOPE("split");
+          blks.emplace_back(R->operator()(n));
+          any_eof |= R->eof();
+        }
       }
       // check if all read files had equal sequences
       const auto exp = blks[0].size();
       for (size_t i = 1; i < blks.size() - !has_plate; ++i) {
         if (blks[i].size() != exp) throw "inconsistent number of sequences in input";
       }
-      // enqueue block-matching job to one of the matching-thread
-      // blocks until a thread is available in gPool
-      match_queue.emplace_back(gPool->async([this, blks = std::move(blks)]() mutable {
-        return this->blk_match<has_plate>(std::move(blks));
-      }));
-      // anything ready yet?
-      // never blocks
-      while (!match_queue.empty() && (std::future_status::ready == match_queue.front().wait_for(0s))) {
-        auto m = match_queue.front().get();   // doesn's block either
-        match_queue.pop_front();
-        process_matches<has_plate>(m);
-      }
-    }
-    // left-overs
-    while (!match_queue.empty()) {
-      auto m = match_queue.front().get();   // might block
-      match_queue.pop_front();
-      process_matches<has_plate>(m);
+      // enqueue block-matching and -rendering job to one of the matching-thread
+      // blocks until a slot in rob and a thread in gPool is available
+      const auto seq = rob.acquire();
+      (void)gPool->async([this, &rob, seq, blks = std::move(blks)]() mutable {
+        try {
+          auto matches = this->blk_match<has_plate>(std::move(blks));
+          auto blk = stats_only ? h4_block_t{} : this->blk_render<has_plate>(matches);
+          blk.reads = matches.first.size();
+          blk.bytes = blk.r1.size() + blk.r2.size() + blk.bam.size();
+          budget->charge(blk.bytes);
+          rob.put(seq, std::move(blk));
+        }
+        catch (...) {
+          rob.put_exception(seq, std::current_exception());
+        }
+      });
+    }
+    rob.close();
+    consumer.join();
+    if (consumer_eptr) std::rethrow_exception(consumer_eptr);
+    if (stop) {
+      throw std::runtime_error("terminated, checkpoint at record " + std::to_string(written.load()) + ". Consider '--resume'");
     }
+    write_stats<has_plate>();
+    if (!stats_only) write_manifest(written);
+    monitor.write_metrics(out_root / "metrics.json");
+    fs::remove(out_root / "checkpoint.json");
     // dump json to output folder for reference
     auto js = std::ofstream(out_root / "H4.json");
     js << J.dump();
   }
 
+  // narrows range to i-th of N balanced parts
+  void shard(size_t i, size_t N) {
+    if (streams()) throw "--shard: can't merge stdout or named pipe outputs";
+    if (range.second == size_t(-1)) {
+      range.second = count_reads(gz_root / J.at("/reads/R1"_json_pointer).get<std::string>());
+      if (range.first >= range.second) throw "range exceeds number of reads";
+    }
+    const auto n = range.second - range.first;
+    range = { range.first + (n * i) / N, range.first + (n * (i + 1)) / N };
+    if (range.first == range.second) throw "empty shard";
+    range_begin = range.first;
+    out_root /= "shard_" + std::to_string(i);
+    shard_ = { i, N };
+  }
+
+  // picks up checkpoint.json written by an interrupted run
+  void resume() {
+    if (streams()) throw "--resume: can't resume stdout or named pipe outputs";
+    auto is = std::ifstream(out_root / "checkpoint.json");
+    if (!is) throw "no checkpoint found in output directory";
+    auto C = json::parse(is);
+    // buffer geometry doesn't affect the output
+    auto strip = [](json j) { j.erase("tuning"); return j; };
+    if (strip(C.at("config")) != strip(J)) throw "checkpoint was written with a different configuration";
+    range.first = C.at("record").get<size_t>();
+    resume_files = C.at("files");
+  }
+
   std::pair<size_t, size_t> range;
+  size_t range_begin = 0;    // first record of the (sharded) range, range.first moves on resume
   fastq::barcode_t bc_A;
   fastq::barcode_t bc_B;
   fastq::barcode_t bc_C;
@@ -253,69 +559,537 @@ struct H4 {
 
   std::unique_ptr<fastq::writer_t<>> R1_out;
   std::unique_ptr<fastq::writer_t<>> R2_out;
+  std::unique_ptr<fastq::writer_t<>> BAM_out;   // bgzf
+  std::string ubam;                             // uBAM file name
+  fastq::codec_t R1_codec;
+  fastq::codec_t R2_codec;
+  fastq::codec_t BAM_codec;
+
+  // per-sample output, buffered per sample and compressed in gPool by the consumer.
+  // at most demux_max_open samples hold buffers, the least recent ones are spilled.
+  using demux_writer_t = fastq::demux_writer_t;
+  std::string demux;                             // "", "plate" or BX prefix
+  std::vector<const fastq::barcode_t*> demux_sets;
+  std::unordered_map<size_t, std::unique_ptr<demux_writer_t>> R1_demux;    // by sample, created on demand
+  std::unordered_map<size_t, std::unique_ptr<demux_writer_t>> R2_demux;
+  std::vector<std::unique_ptr<demux_writer_t::compressor_t>> demux_cs;     // one per pool thread
+  std::vector<demux_writer_t*> demux_open;      // holding buffers
+  size_t demux_max_open = 1024;
+
+  // effective buffer geometry
+  json tuning() const {
+    return json{
+      { "blk_size", blk_size },
+      { "reader", { { "chunk_size", reader_geo.chunk_size }, { "chunks", reader_geo.chunks }, { "gz_buffer", reader_geo.gz_buffer } } },
+      { "writer", { { "chunk_size", writer_geo.chunk_size }, { "chunks", writer_geo.chunks } } },
+      { "memory_mb", memory_mb }
+    };
+  }
+
+  // read structure, see fastq/layout.hpp
+  fastq::layout_t layout;
+  fastq::layout_t::expr_t clip;                       // R2 (R4) clipping position
+  std::vector<ReadIdx> rx_reads = { R2_, R3_ };        // RX, RX:Z: and QX:Z: tags
+  std::string bx_order = "ACBD";                      // BX:Z: tag, plate appended
+
+  size_t blk_size = 10000;              // reads per matching job
+  reader_geometry_t reader_geo;
+  writer_geometry_t writer_geo;
+  size_t memory_mb = 0;                          // 0: unlimited
+  std::shared_ptr<hahi::budget_t> budget;        // readers, blocks in flight and writers
+  std::chrono::seconds checkpoint_interval{0};   // 0: on SIGTERM only
+  json resume_files = json::object();            // file -> stream_pos_t at checkpoint
+  std::pair<size_t, size_t> shard_{0, 1};
 
   bool verbose = false;
+  bool stats_only = false;
+  bench_t bench;
   bool clipping = false;
   bool r1_out = false;
+  bool interleaved = false;     // R1 and R2 records alternating in R1 output
   std::filesystem::path bc_root;
   std::filesystem::path gz_root;
   std::filesystem::path out_root;
   const json& J;
 
+  // busy time of the pipeline stages, summed over threads
+  enum stage_t { split_stage, match_stage, render_stage, write_stage, num_stages };
+  static constexpr const char* stage_names[] = { "split", "match", "render", "write_block" };
+  std::chrono::nanoseconds stage_time(stage_t stage) const noexcept { return std::chrono::nanoseconds(stage_time_[stage].load(std::memory_order_relaxed)); }
+
 private:
+  struct stage_timer_t {
+    std::atomic<int64_t>& ns;
+    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    ~stage_timer_t() { ns.fetch_add((std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed); }
+  };
+  std::array<std::atomic<int64_t>, num_stages> stage_time_{};   // ns
+
   struct h4_match_t {
-    int sn = 0;
     fastq::match_t s, a, b, c, d, p;
+    size_t clip = 0;    // R2 clipping position
     bool any_invalid = false;
     bool any_unclear = false;
   };
   using h4_matches_t = std::pair<std::vector<h4_match_t>, blks_t>;
 
-  // matching 
+  // compiled layout
+  std::vector<fastq::match_t h4_match_t::*> seg_slot;    // layout segment -> match
+  std::vector<std::pair<const fastq::barcode_t*, fastq::match_t h4_match_t::*>> bx_fields;
+  bool match_rx = false;    // any segment in RX
+
+  // /layout, defaults to the H4 read structure:
+  // R4: stagger at 0; RX = R2 + R3: D at 0, B at B+1, A at B+D+1 with stagger
+  // dependent length, C behind A and a spacer; I1: plate at 0.
+  void parse_layout() {
+    auto jl = json::object();
+    optional_json(jl = J.at("layout"));
+    auto read_idx = [&](const json& j) {
+      const auto name = j.get<std::string>();
+      for (unsigned r = R1_; r <= RX_; ++r) {
+        if (name == read_names[r]) {
+          if ((r == I1_) && !has_plate()) throw "layout: read I1 requires plate barcodes";
+          return r;
+        }
+      }
+      throw std::runtime_error("layout: unknown read '" + name + '\'');
+    };
+    auto slot = [&](const std::string& name) -> std::pair<fastq::barcode_t*, fastq::match_t h4_match_t::*> {
+      if (name == "stagger") return { &stagger, &h4_match_t::s };
+      if (name == "plate") return { &plate, &h4_match_t::p };
+      if (name == "A") return { &bc_A, &h4_match_t::a };
+      if (name == "B") return { &bc_B, &h4_match_t::b };
+      if (name == "C") return { &bc_C, &h4_match_t::c };
+      if (name == "D") return { &bc_D, &h4_match_t::d };
+      throw std::runtime_error("layout: unknown barcode set '" + name + "', expected A, B, C, D, stagger or plate");
+    };
+    if (jl.contains("rx")) {
+      rx_reads.clear();
+      for (const auto& r : jl.at("rx")) {
+        const auto idx = read_idx(r);
+        if (idx == RX_) throw "layout: RX can't contain itself";
+        rx_reads.push_back(ReadIdx(idx));
+      }
+      if (rx_reads.size() > 5) throw "layout: too many rx reads";
+    }
+    auto specs = std::vector<fastq::layout_t::spec_t>{};
+    if (jl.contains("segments")) {
+      auto expr = [](const json& j) { return j.is_number() ? std::to_string(j.get<size_t>()) : j.get<std::string>(); };
+      for (const auto& js : jl.at("segments")) {
+        const auto name = js.at("barcode").get<std::string>();
+        specs.push_back({ name, slot(name).first, read_idx(js.at("read")), expr(js.at("offset")), js.contains("length") ? expr(js.at("length")) : "" });
+      }
+    }
+    else {
+      specs = {
+        { "stagger", &stagger, R4_, "0" },
+        { "B", &bc_B, RX_, "B+1" },
+        { "D", &bc_D, RX_, "0" },
+        { "A", &bc_A, RX_, "B+D+1", "A.min+stagger.shift" },
+        { "C", &bc_C, RX_, "B+D+A.min+stagger.shift+2" }
+      };
+      if (has_plate()) specs.push_back({ "plate", &plate, I1_, "0" });
+    }
+    layout = fastq::layout_t{specs};
+    for (const char* name : { "stagger", "A", "B", "C", "D" }) {
+      if (layout.find(name) == -1) throw std::runtime_error(std::string("layout: missing segment ") + name);
+    }
+    if (has_plate() != (layout.find("plate") != -1)) throw "layout: plate segment required if and only if plate barcodes are given";
+    seg_slot.clear();
+    for (const auto& seg : layout) {
+      seg_slot.push_back(slot(seg.name).second);
+      match_rx |= (seg.read == RX_);
+    }
+    clip = layout.compile(jl.value("clip", "stagger+1+A.len"));
+    bx_order = jl.value("bx", bx_order);
+    if (bx_order.empty()) throw "layout: empty bx";
+    bx_fields.clear();
+    for (char L : bx_order) {
+      if ((std::string_view("ABCD").find(L) == std::string_view::npos) || (bx_order.find(L) != bx_order.rfind(L))) {
+        throw "layout: bx shall be distinct letters of A, B, C and D";
+      }
+      bx_fields.emplace_back(&bc(L), slot(std::string(1, L)).second);
+    }
+  }
+
+  // barcode statistics, one instance per thread, merged at the end
+  struct h4_stats_t {
+    static constexpr size_t max_ed = 16;   // last bin collects ed >= max_ed
+    enum { correct, corrected, unclear };
+    enum { S, A, B, C, D, P, segments };
+    
+    std::unordered_map<uint64_t, std::array<size_t, 3>> codes;   // packed (A,C,B,D,plate) -> counts
+    std::array<std::array<size_t, max_ed + 2>, segments> ed_hist{};   // [segment][invalid, ed 0, ...]
+
+    // 12 bit per barcode index
+    static uint64_t pack(const h4_match_t& m) noexcept {
+      return uint64_t(m.a.idx) | (uint64_t(m.c.idx) << 12) | (uint64_t(m.b.idx) << 24) | (uint64_t(m.d.idx) << 36) | (uint64_t(m.p.idx) << 48);
+    }
+
+    // classification follows the legacy code: A, B, C, D only
+    void count(const h4_match_t& m) {
+      using fastq::ReadType;
+      int type = correct;
+      for (auto rt : { m.a.rt, m.b.rt, m.c.rt, m.d.rt }) {
+        if (rt <= ReadType::unclear) { type = unclear; break; }
+        if (rt == ReadType::corrected) type = corrected;
+      }
+      ++codes[pack(m)][type];
+      int seg = 0;
+      for (const auto& x : { m.s, m.a, m.b, m.c, m.d, m.p }) {
+        ++ed_hist[seg++][(x.rt == ReadType::invalid) ? 0 : 1 + std::min<size_t>(x.ed, max_ed)];
+      }
+    }
+
+    void merge(const h4_stats_t& other) {
+      for (const auto& [key, cnt] : other.codes) {
+        auto& c = codes[key];
+        for (size_t i = 0; i < c.size(); ++i) c[i] += cnt[i];
+      }
+      for (size_t seg = 0; seg < segments; ++seg) {
+        for (size_t i = 0; i < ed_hist[seg].size(); ++i) ed_hist[seg][i] += other.ed_hist[seg][i];
+      }
+    }
+  };
+
+  // per-thread statistics, registers itself on first use.
+  // lock-free after that.
+  h4_stats_t& local_stats() {
+    thread_local std::pair<const H4*, h4_stats_t*> tls{nullptr, nullptr};
+    if (tls.first != this) {
+      std::lock_guard<std::mutex> _(stats_mutex_);
+      tls = { this, stats_.emplace_back(new h4_stats_t{}).get() };
+    }
+    return *tls.second;
+  }
+
+  // legacy clearBC.log and unclearBC.log, plus edHist.log
+  template <bool has_plate>
+  void write_stats() {
+    auto tot = h4_stats_t{};
+    for (const auto& st : stats_) tot.merge(*st);
+    auto code_str = [&](uint64_t key) {
+      auto idx = [&](int shift) { return (key >> shift) & 0xFFF; };
+      auto str = bc_A[idx(0)].tag + bc_C[idx(12)].tag + bc_B[idx(24)].tag + bc_D[idx(36)].tag;
+      if constexpr (has_plate) str += plate[idx(48)].tag;
+      return str;
+    };
+    auto codes = std::vector<std::pair<std::string, std::array<size_t, 3>>>{};
+    codes.reserve(tot.codes.size());
+    for (const auto& [key, cnt] : tot.codes) codes.emplace_back(code_str(key), cnt);
+    std::sort(codes.begin(), codes.end());
+    auto clear = std::ofstream(out_root / "clearBC.log");
+    clear << "Barcode \t Correct reads \t Corrected reads\n";
+    for (const auto& [code, cnt] : codes) {
+      if (cnt[h4_stats_t::correct] + cnt[h4_stats_t::corrected]) {
+        clear << code << '\t' << cnt[h4_stats_t::correct] << '\t' << cnt[h4_stats_t::corrected] << '\n';
+      }
+    }
+    auto unclear = std::ofstream(out_root / "unclearBC.log");
+    unclear << "Barcode \t Reads\n";
+    for (const auto& [code, cnt] : codes) {
+      if (cnt[h4_stats_t::unclear]) {
+        unclear << code << '\t' << cnt[h4_stats_t::unclear] << '\n';
+      }
+    }
+    auto hist = std::ofstream(out_root / "edHist.log");
+    hist << "ed\tstagger\tA\tB\tC\tD\tplate\n";
+    for (size_t i = 0; i < h4_stats_t::max_ed + 2; ++i) {
+      if (i == 0) hist << "invalid";
+      else if (i == h4_stats_t::max_ed + 1) hist << ">=" << h4_stats_t::max_ed;
+      else hist << (i - 1);
+      for (size_t seg = 0; seg < h4_stats_t::segments; ++seg) hist << '\t' << tot.ed_hist[seg][i];
+      hist << '\n';
+    }
+  }
+
+  std::mutex stats_mutex_;
+  std::vector<std::unique_ptr<h4_stats_t>> stats_;
+
+  // samples queues and pool at 10Hz in a side thread, 
+  // prints a status line every 10s if verbose.
+  // pipeline stages only maintain atomic counters. 
+  class telemetry_t {
+  public:
+    static constexpr auto sample_interval = std::chrono::milliseconds(100);
+    static constexpr auto status_interval = std::chrono::seconds(10);
+
+    telemetry_t(H4& h4, const std::vector<Splitter*>& RS, const std::atomic<size_t>& reads)
+    : h4_(h4), RS_(RS), reads_(reads), reads0_(reads), t0_(clock_t::now()), in_(RS.size()) {
+      thread_ = std::jthread([this](std::stop_token stok) {
+        auto next_status = t0_ + status_interval;
+        while (!stok.stop_requested()) {
+          std::this_thread::sleep_for(sample_interval);
+          sample();
+          if (h4_.verbose && (clock_t::now() >= next_status)) {
+            status();
+            next_status += status_interval;
+          }
+        }
+      });
+    }
+
+    // final report, stops sampling
+    void write_metrics(const fs::path& path) {
+      thread_.request_stop();
+      thread_.join();
+      const auto elapsed = seconds(clock_t::now() - t0_);
+      const auto reads = reads_.load() - reads0_;
+      auto M = json{
+        { "elapsed_s", elapsed },
+        { "reads", reads },
+        { "reads_per_s", reads / elapsed },
+        { "pool", {
+          { "threads", gPool->num_threads() },
+          { "busy_fraction", samples_ ? pool_busy_ / (samples_ * gPool->num_threads()) : 0.0 },
+          { "async_wait_s", seconds(gPool->async_wait()) }
+        }},
+        { "memory", {
+          { "budget_mb", h4_.memory_mb },
+          { "peak_mb", double(h4_.budget->peak()) / (1 << 20) },
+          { "wait_s", seconds(h4_.budget->acquire_wait()) }
+        }},
+        { "inputs", json::object() },
+        { "outputs", json::object() }
+      };
+      for (size_t i = 0; i < RS_.size(); ++i) {
+        const auto& reader = RS_[i]->reader();
+        M["inputs"][reader.path().filename().string()] = io_json(reader.tot_bytes(), reader.gz_bytes(), reader.queue(), &in_[i], elapsed);
+      }
+      h4_.for_each_writer([&](auto& writer, const std::string& file) {
+        const void* w = &writer;
+        const auto* samples = (w == h4_.R1_out.get()) ? &out_[0] : (w == h4_.R2_out.get()) ? &out_[1] : nullptr;
+        if constexpr (requires { writer.queue(); }) {
+          M["outputs"][file] = io_json(writer.tot_bytes(), writer.tot_gz_bytes(), writer.queue(), samples, elapsed);
+        }
+        else {
+          M["outputs"][file] = io_json(writer.tot_bytes(), writer.tot_gz_bytes(), elapsed);    // per-sample, no queue
+        }
+        if (writer.geometry().codec.adaptive()) M["outputs"][file]["mean_level"] = writer.mean_level();
+      });
+      // busy time per stage (summed over threads) and reads per busy second
+      auto stage = [&](const char* name, std::chrono::nanoseconds busy) {
+        const auto busy_s = seconds(busy);
+        M["stages"][name] = { { "busy_s", busy_s }, { "reads_per_busy_s", (busy_s > 0) ? reads / busy_s : 0.0 } };
+      };
+      auto inflate = std::chrono::nanoseconds{0};
+      for (auto* R : RS_) inflate += R->reader().inflate_time();
+      stage("inflate", inflate);
+      for (int st = 0; st < num_stages; ++st) stage(stage_names[st], h4_.stage_time(stage_t(st)));
+      auto deflate = std::chrono::nanoseconds{0};
+      h4_.for_each_writer([&](auto& writer, const std::string&) { deflate += writer.deflate_time(); });
+      stage("deflate", deflate);
+      auto os = std::ofstream(path);
+      os << M.dump(2) << '\n';
+    }
+
+  private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct queue_samples_t {
+      double sum = 0;
+      size_t max = 0;
+      void operator()(size_t n) { sum += n; max = std::max(max, n); }
+    };
+
+    static double seconds(clock_t::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    json io_json(size_t bytes, size_t gz_bytes, double elapsed) const {
+      return json{
+        { "bytes", bytes },
+        { "gz_bytes", gz_bytes },
+        { "MB_per_s", 1e-6 * bytes / elapsed },
+        { "gz_MB_per_s", 1e-6 * gz_bytes / elapsed }
+      };
+    }
+
+    template <typename Queue>
+    json io_json(size_t bytes, size_t gz_bytes, const Queue& q, const queue_samples_t* samples, double elapsed) const {
+      auto j = io_json(bytes, gz_bytes, elapsed);
+      j["queue"] = {
+        { "max_size", q.max_size() },
+        { "push_wait_s", seconds(q.push_wait()) },
+        { "pop_wait_s", seconds(q.pop_wait()) }
+      };
+      if (samples && samples_) {
+        j["queue"]["mean_size"] = samples->sum / samples_;
+        j["queue"]["peak_size"] = samples->max;
+      }
+      return j;
+    }
+
+    void sample() {
+      ++samples_;
+      pool_busy_ += gPool->busy();
+      for (size_t i = 0; i < RS_.size(); ++i) in_[i](RS_[i]->reader().queue().size());
+      // per-sample writers are created on the fly, not sampled
+      if (h4_.R1_out) out_[0](h4_.R1_out->queue().size());
+      if (h4_.R2_out) out_[1](h4_.R2_out->queue().size());
+    }
+
+    void status() const {
+      const auto elapsed = seconds(clock_t::now() - t0_);
+      const auto reads = reads_.load() - reads0_;
+      size_t in = 0;
+      for (auto* R : RS_) in += R->reader().gz_bytes();
+      size_t out = 0;
+      if (h4_.R1_out) out += h4_.R1_out->tot_gz_bytes();
+      if (h4_.R2_out) out += h4_.R2_out->tot_gz_bytes();
+      std::cerr << std::fixed << std::setprecision(1) << '[' << elapsed << "s] " 
+                << reads << " reads (" << size_t(reads / elapsed) << "/s)"
+                << "  in " << 1e-6 * in / elapsed << " MB/s"
+                << "  out " << 1e-6 * out / elapsed << " MB/s"
+                << "  pool " << size_t(100 * gPool->busy() / gPool->num_threads()) << '%'
+                << "  mem " << (h4_.budget->used() >> 20) << " MB"
+                << "  queues";
+      for (auto* R : RS_) std::cerr << ' ' << R->reader().queue().size();
+      if (h4_.R1_out) std::cerr << " | " << h4_.R1_out->queue().size();
+      if (h4_.R2_out) std::cerr << ' ' << h4_.R2_out->queue().size();
+      if (h4_.R1_out && h4_.R1_out->geometry().codec.adaptive()) std::cerr << "  level " << h4_.R1_out->level();
+      if (h4_.R2_out && h4_.R2_out->geometry().codec.adaptive()) std::cerr << (h4_.R1_out ? " " : "  level ") << h4_.R2_out->level();
+      std::cerr << std::endl;
+    }
+
+    H4& h4_;
+    const std::vector<Splitter*>& RS_;
+    const std::atomic<size_t>& reads_;
+    const size_t reads0_;
+    const clock_t::time_point t0_;
+    size_t samples_ = 0;
+    double pool_busy_ = 0;
+    std::vector<queue_samples_t> in_;
+    std::array<queue_samples_t, 2> out_;
+    std::jthread thread_;
+  };
+
+  // rendered output of one block
+  struct h4_block_t {
+    struct route_t {
+      size_t sample;
+      size_t r1_end;    // end of read in r1
+      size_t r2_end;    // end of read in r2
+    };
+
+    std::string r1;
+    std::string r2;
+    std::string bam;               // uncompressed uBAM records
+    std::vector<route_t> routes;   // per read, demux only
+    size_t reads = 0;
+    size_t bytes = 0;              // charged to the budget until handed to the writers
+  };
+
+  // mixed-radix sample index
+  size_t sample_of(const h4_match_t& m) const {
+    if (demux_sets.size() == 1 && demux_sets[0] == &plate) return m.p.idx;
+    size_t sample = 0;
+    for (auto it = demux_sets.rbegin(); it != demux_sets.rend(); ++it) {
+      const auto* bc = *it;
+      const int idx = (bc == &bc_A) ? m.a.idx : (bc == &bc_C) ? m.c.idx : (bc == &bc_B) ? m.b.idx : m.d.idx;
+      sample = sample * bc->size() + idx;
+    }
+    return sample;
+  }
+
+  // concatenated tags
+  std::string sample_name(size_t sample) const {
+    auto name = std::string{};
+    for (const auto* bc : demux_sets) {
+      name += (*bc)[sample % bc->size()].tag;
+      sample /= bc->size();
+    }
+    return name;
+  }
+
+  // matching, one match_block call per layout segment
   template <bool has_plate>
   h4_matches_t blk_match(blks_t&& blks) {
-    auto matches = std::vector<h4_match_t>{};
-    matches.reserve(blks.size());
-    // expected code lengths
-    const size_t scl = stagger.max_code_length();
-    const size_t bcl = bc_B.max_code_length();           
-    const size_t dcl = bc_D.max_code_length();
-    const size_t ccl = bc_C.max_code_length();  
-    const size_t pcl = plate.max_code_length();   // always defined, 0 if empty
-    std::string RX{};
-    for (size_t i = 0; i < blks[0].size(); ++i) {
-      auto& m = matches.emplace_back();
-      m.s = fastq::min_edit_distance(fastq::max_substr(blks[R4_][i][1], 0, scl), scl, stagger);
-      m.sn = (m.s.rt <= fastq::ReadType::unclear) ? 0 : m.s.idx - 1;   // rerquires 'sorted' stagger barcodes
-      RX = blks[R2_][i][1];
-      RX.append(blks[R3_][i][1]);
-      m.b = fastq::min_edit_distance(fastq::max_substr(RX, bcl + 1, bcl), bcl, bc_B);
-      m.d = fastq::min_edit_distance(fastq::max_substr(RX, 0, dcl), dcl, bc_D);
-      const auto acl = bc_A.min_code_length() + m.sn;
-      m.a = fastq::min_edit_distance(fastq::max_substr(RX, bcl + dcl + 1, acl), acl, bc_A);
-      m.c = fastq::min_edit_distance(fastq::max_substr(RX, bcl + dcl + acl + 2, ccl), ccl, bc_C);
+    HAHI_TRACE_SCOPE("match");
+    auto _ = stage_timer_t{stage_time_[match_stage]};
+    const size_t n = blks[0].size();
+    const size_t ns = layout.size();
+    auto matches = std::vector<h4_match_t>(n);
+    // RX = concatenated rx_reads, packed into one buffer
+    auto RX = std::string{};
+    auto rx = std::vector<fastq::str_view>{};
+    if (match_rx) {
+      size_t rx_len = 0;
+      for (size_t i = 0; i < n; ++i) {
+        for (auto r : rx_reads) rx_len += blks[r][i][1].length();
+      }
+      RX.reserve(rx_len);
+      rx.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        const auto first = RX.length();
+        for (auto r : rx_reads) RX.append(blks[r][i][1]);
+        rx[i] = { RX.data() + first, RX.length() - first };
+      }
+    }
+    auto read = [&](unsigned r, size_t i) { return (r == RX_) ? rx[i] : blks[r][i][1]; };
+    // per read: matches and window ends of the segments so far, see layout_t::eval
+    auto seg_m = std::vector<fastq::match_t>(n * ns);
+    auto seg_end = std::vector<uint32_t>(n * ns);
+    auto win = std::vector<fastq::str_view>(n);
+    auto res = std::vector<fastq::match_t>(n);
+    for (size_t k = 0; k < ns; ++k) {
+      const auto& seg = layout[k];
+      size_t code_length = 1;   // dynamic windows: short windows are passed as invalid (empty)
+      if (seg.is_static()) {
+        // fast path, short windows are invalid by code_length
+        const auto off = seg.offset.constant;
+        code_length = seg.length.constant;
+        for (size_t i = 0; i < n; ++i) {
+          win[i] = fastq::max_substr(read(seg.read, i), off, code_length);
+          seg_end[i * ns + k] = static_cast<uint32_t>(off + code_length);
+        }
+      }
+      else {
+        for (size_t i = 0; i < n; ++i) {
+          const auto m = std::span<const fastq::match_t>(seg_m.data() + i * ns, ns);
+          const auto e = std::span<const uint32_t>(seg_end.data() + i * ns, ns);
+          const auto off = layout.eval(seg.offset, m, e);
+          const auto len = layout.eval(seg.length, m, e);
+          const auto w = fastq::max_substr(read(seg.read, i), off, len);
+          win[i] = (w.length() < len) ? fastq::str_view{} : w;
+          seg_end[i * ns + k] = static_cast<uint32_t>(off + len);
+        }
+      }
+      if (bench.identity_match) std::fill(res.begin(), res.end(), fastq::match_t{});
+      else fastq::match_block(win, code_length, *seg.bc, res);
+      for (size_t i = 0; i < n; ++i) {
+        seg_m[i * ns + k] = res[i];
+        matches[i].*seg_slot[k] = res[i];
+      }
+    }
+    for (size_t i = 0; i < n; ++i) {
+      matches[i].clip = layout.eval(clip, { seg_m.data() + i * ns, ns }, { seg_end.data() + i * ns, ns });
+    }
+    // summary
+    auto& stats = local_stats();
+    for (auto& m : matches) {
       if constexpr (has_plate) {
-        m.p = fastq::min_edit_distance(fastq::max_substr(blks[I1_][i][1], 0, pcl), pcl, plate);
         m.any_invalid = (m.p.rt == fastq::ReadType::invalid);
         m.any_unclear = (m.p.rt == fastq::ReadType::unclear);
       }
-      // summary
       for (fastq::ReadType rt : { m.s.rt, m.a.rt, m.b.rt, m.c.rt, m.d.rt }) {
         m.any_invalid |= (rt == fastq::ReadType::invalid);
         m.any_unclear |= (rt == fastq::ReadType::unclear);
       }
+      stats.count(m);
     }
     return { std::move(matches), std::move(blks) };
   }
 
-  // output processing
+  // output formatting
+  // out1(str) appends to R1, out2(str) appends to R2
+  // eor(i) is called at the end of read i
   template <bool has_plate, bool has_clipping>
-  void do_process_matches(const h4_matches_t& h4_matches,
-                          auto put,
-                          auto puts) {
+  void do_render(const h4_matches_t& h4_matches, auto&& out1, auto&& out2, auto&& eor) {
     const auto& matches = h4_matches.first;
     const auto& blks = h4_matches.second;
-    const size_t pcl = plate.max_code_length();   // always defined, 0 if empty
+    auto put = [&](fastq::str_view str) { 
+      out1(str); 
+      if constexpr (has_clipping) out2(str); 
+    };
     for (size_t i = 0; i < blks[0].size(); ++i) {
       const auto& match = matches[i];
 
@@ -323,72 +1097,474 @@ private:
       const auto name = blks[R1_][i][0];
       put(name.substr(0, name.find_first_of(" \t")));
       put("\tBX:Z:");
-      put(bc_A[match.a.idx].tag);
-      put(bc_C[match.c.idx].tag);
-      put(bc_B[match.b.idx].tag);
-      put(bc_D[match.d.idx].tag);
+      for (const auto& [bc, m] : bx_fields) put((*bc)[(match.*m).idx].tag);
       if constexpr (has_plate) {
         put("-");
         put(plate[match.p.idx].tag);
       }
       put("\tRX:Z:");
-      put(blks[R2_][i][1]);
-      put(blks[R3_][i][1]);
+      for (auto r : rx_reads) put(blks[r][i][1]);
       if constexpr (has_plate) {
         put("+");
         put(blks[I1_][i][1]);
       }
       put("\tQX:Z:");
-      put(blks[R2_][i][3]);
-      put(blks[R3_][i][3]);
+      for (auto r : rx_reads) put(blks[r][i][3]);
       if constexpr (has_plate) {
         put("+");
         put(blks[I1_][i][3]);
       }
-      puts({});
+      put("\n");
 
-      // copy over unchanged fields to R1_out
-      for (auto j : {1,2,3}) R1_out->puts(blks[R1_][i][j]);
+      // copy over unchanged fields to R1
+      for (auto j : {1,2,3}) { out1(blks[R1_][i][j]); out1("\n"); }
 
       if constexpr (has_clipping) {
-        // copy clipped fields to R2_out
-        auto clip_size = stagger.max_code_length() + 1;
-        clip_size += (match.a.rt == fastq::ReadType::unclear) 
-                    ? bc_A.max_code_length()
-                    : bc_A[match.a.idx].code.length();
-        R2_out->puts(fastq::max_substr(blks[R4_][i][1], clip_size));
-        R2_out->puts(blks[R4_][i][2]);
-        R2_out->puts(fastq::max_substr(blks[R4_][i][3], clip_size));
+        // copy clipped fields to R2
+        out2(fastq::max_substr(blks[R4_][i][1], match.clip)); out2("\n");
+        out2(blks[R4_][i][2]); out2("\n");
+        out2(fastq::max_substr(blks[R4_][i][3], match.clip)); out2("\n");
       }
+      eor(i);
     }
   }
 
-  template <bool has_plate>
-  void process_matches(const h4_matches_t& h4_matches) {
-    if (clipping) {
-      // creates a lot of redundant data...
-      do_process_matches<has_plate, true>(
-        h4_matches, 
-        [this](fastq::str_view str) { R1_out->put(str); R2_out->put(str); },
-        [this](fastq::str_view str) { R1_out->puts(str); R2_out->puts(str); }
-      );
-    }                                   
-    else {
-      do_process_matches<has_plate, false>(
-        h4_matches, 
-        [this](fastq::str_view str) { R1_out->put(str); },
-        [this](fastq::str_view str) { R1_out->puts(str); }
+  // renders block into pre-sized buffers, runs in the pool
+  template <bool has_plate, bool has_clipping>
+  h4_block_t do_blk_render(const h4_matches_t& h4_matches) {
+    // 1st pass: exact sizes
+    size_t n1 = 0, n2 = 0;
+    do_render<has_plate, has_clipping>(h4_matches, 
+      [&](fastq::str_view str) { n1 += str.length(); },
+      [&](fastq::str_view str) { n2 += str.length(); },
+      [](size_t) {}
+    );
+    // 2nd pass: render
+    auto blk = h4_block_t{};
+    if (interleaved) {
+      // R2 record follows its R1 record
+      blk.r1.reserve(n1 + n2);
+      auto rec2 = std::string{};
+      do_render<has_plate, has_clipping>(h4_matches, 
+        [&](fastq::str_view str) { blk.r1.append(str); },
+        [&](fastq::str_view str) { rec2.append(str); },
+        [&](size_t) { blk.r1.append(rec2); rec2.clear(); }
       );
+      assert(blk.r1.size() == n1 + n2);
+      return blk;
+    }
+    blk.r1.reserve(n1);
+    blk.r2.reserve(n2);
+    if (!demux.empty()) blk.routes.reserve(h4_matches.first.size());
+    do_render<has_plate, has_clipping>(h4_matches, 
+      [&](fastq::str_view str) { blk.r1.append(str); },
+      [&](fastq::str_view str) { blk.r2.append(str); },
+      [&](size_t i) { 
+        if (!demux.empty()) blk.routes.push_back({ sample_of(h4_matches.first[i]), blk.r1.size(), blk.r2.size() });
+      }
+    );
+    assert((blk.r1.size() == n1) && (blk.r2.size() == n2));
+    if (!r1_out) blk.r1 = std::string{};
+    return blk;
+  }
+
+  // renders block as unaligned BAM, R1 and clipped R2 as pair
+  template <bool has_plate>
+  std::string bam_render(const h4_matches_t& h4_matches) const {
+    const auto& matches = h4_matches.first;
+    const auto& blks = h4_matches.second;
+    auto out = std::string{};
+    if (blks[0].size()) {
+      // estimate from 1st read
+      auto len = blks[R1_][0][0].length() + blks[R1_][0][1].length();
+      for (auto r : rx_reads) len += blks[r][0][1].length();
+      out.reserve(blks[0].size() * 4 * (64 + len));
+    }
+    for (size_t i = 0; i < blks[0].size(); ++i) {
+      const auto& match = matches[i];
+      auto name = blks[R1_][i][0];
+      name = name.substr(1, name.find_first_of(" \t") - 1);   // strip '@' and comment
+      if (name.ends_with("/1")) name.remove_suffix(2);
+      auto bx = std::array<fastq::str_view, 6>{};
+      auto rx = std::array<fastq::str_view, 7>{};
+      auto qx = std::array<fastq::str_view, 7>{};
+      size_t nbx = 0, nx = 0;
+      for (const auto& [bc, m] : bx_fields) bx[nbx++] = (*bc)[(match.*m).idx].tag;
+      for (auto r : rx_reads) { rx[nx] = blks[r][i][1]; qx[nx++] = blks[r][i][3]; }
+      if constexpr (has_plate) {
+        bx[nbx++] = "-";
+        bx[nbx++] = plate[match.p.idx].tag;
+        rx[nx] = qx[nx] = "+";
+        rx[++nx] = blks[I1_][i][1];
+        qx[nx++] = blks[I1_][i][3];
+      }
+      const auto tags = { 
+        fastq::bam::tag_t{ {'B', 'X'}, { bx.data(), nbx } },
+        fastq::bam::tag_t{ {'R', 'X'}, { rx.data(), nx } },
+        fastq::bam::tag_t{ {'Q', 'X'}, { qx.data(), nx } }
+      };
+      fastq::bam::append_record(out, name, fastq::bam::flag_r1, blks[R1_][i][1], blks[R1_][i][3], tags);
+      fastq::bam::append_record(out, name, fastq::bam::flag_r2, 
+                                fastq::max_substr(blks[R4_][i][1], match.clip), 
+                                fastq::max_substr(blks[R4_][i][3], match.clip), tags);
+    }
+    return out;
+  }
+
+  template <bool has_plate>
+  h4_block_t blk_render(const h4_matches_t& h4_matches) {
+    HAHI_TRACE_SCOPE("render");
+    auto _ = stage_timer_t{stage_time_[render_stage]};
+    auto blk = !(r1_out || clipping) ? h4_block_t{}
+             : clipping ? do_blk_render<has_plate, true>(h4_matches)
+                        : do_blk_render<has_plate, false>(h4_matches);
+    if (!ubam.empty()) blk.bam = bam_render<has_plate>(h4_matches);
+    return blk;
+  }
+
+  // hands rendered block over to the writers, consumer thread
+  void write_block(h4_block_t&& blk) {
+    HAHI_TRACE_SCOPE("write_block");
+    if (stats_only || bench.null_writer) return;
+    auto _ = stage_timer_t{stage_time_[write_stage]};
+    if (!demux.empty()) {
+      write_demux_block(blk);
+      return;
+    }
+    if (r1_out) R1_out->submit(std::move(blk.r1));
+    if (R2_out) R2_out->submit(std::move(blk.r2));
+    if (BAM_out) BAM_out->submit(std::move(blk.bam));
+  }
+
+  // stream position at checkpoint, default: new file
+  fastq::stream_pos_t append_at(const std::string& file) const {
+    auto it = resume_files.find(file);
+    return (it != resume_files.end()) ? it->get<fastq::stream_pos_t>() : fastq::stream_pos_t{};
+  }
+
+  // calls fun(writer, file name) for all existing writers
+  template <typename Fun>
+  void for_each_writer(Fun&& fun) {
+    const auto R1 = J.at("output").at("R1").get<std::string>();
+    const auto R2 = J.at("output").at("R2").get<std::string>();
+    if (R1_out) fun(*R1_out, R1);
+    if (R2_out) fun(*R2_out, R2);
+    if (BAM_out) fun(*BAM_out, ubam);
+    for (auto& [s, writer] : R1_demux) fun(*writer, sample_name(s) + '_' + R1);
+    for (auto& [s, writer] : R2_demux) fun(*writer, sample_name(s) + '_' + R2);
+  }
+
+  // writes json atomically
+  void write_json(const char* name, const json& j) {
+    {
+      auto os = std::ofstream(out_root / (std::string(name) + ".tmp"));
+      os << j.dump(2);
+      if (!os.flush()) throw std::runtime_error(std::string("failed to write ") + name);
+    }
+    fs::rename(out_root / (std::string(name) + ".tmp"), out_root / name);
+  }
+
+  // finishes gzip members of all outputs and records the position
+  // consumer thread
+  void write_checkpoint(size_t record) {
+    flush_demux(demux_writer_t::flush_t::sync);
+    auto syncs = std::vector<std::pair<std::string, std::future<fastq::stream_pos_t>>>{};
+    for_each_writer([&](auto& writer, const std::string& file) {
+      syncs.emplace_back(file, writer.sync());
+    });
+    auto C = json{ { "record", record }, { "config", J }, { "files", json::object() } };
+    for (auto& [file, pos] : syncs) C["files"][file] = pos.get();
+    write_json("checkpoint.json", C);
+    if (verbose) std::cerr << "checkpoint at record " << record << std::endl;
+  }
+
+  // closes all outputs and records what was written, see fastq_merge
+  void write_manifest(size_t record) {
+    auto M = json{ 
+      { "shard", { shard_.first, shard_.second } },
+      { "range", { range_begin, record } },
+      { "output", { { "R1", r1_out ? J.at("/output/R1"_json_pointer) : "" }, { "R2", (clipping && !interleaved) ? J.at("/output/R2"_json_pointer) : "" } } },
+      { "interleaved", interleaved },    // R1 holds R1 and R2 records
+      { "files", json::object() }
+    };
+    flush_demux(demux_writer_t::flush_t::last);
+    for_each_writer([&](auto& writer, const std::string& file) {
+      writer.close(true);
+      M["files"][file] = writer.stream_pos();
+    });
+    write_json("manifest.json", M);
+  }
+
+  // routes runs of reads to per-sample writers, compresses full chunks
+  void write_demux_block(const h4_block_t& blk) {
+    auto full = std::vector<demux_writer_t*>{};
+    auto writer = [&](auto& writers, size_t sample, const char* L) -> demux_writer_t& {
+      auto& writer = writers[sample];
+      if (!writer) {
+        const auto file = J.at("output").at(L).get<std::string>();
+        const auto name = sample_name(sample) + '_' + file;
+        writer.reset(new demux_writer_t{out_root / name, append_at(name), { .codec = (L[1] == '1') ? R1_codec : R2_codec, .budget = budget }});
+      }
+      if (!writer->open()) demux_open.push_back(writer.get());
+      return *writer;
+    };
+    auto put = [&](demux_writer_t& writer, std::string_view str) {
+      const bool was_full = writer.full();
+      writer.put(str);
+      if (!was_full && writer.full()) full.push_back(&writer);
+    };
+    size_t r1_begin = 0, r2_begin = 0;
+    for (size_t i = 0; i < blk.routes.size();) {
+      const auto sample = blk.routes[i].sample;
+      while ((i + 1 < blk.routes.size()) && (blk.routes[i + 1].sample == sample)) ++i;   // run
+      const auto& route = blk.routes[i++];
+      if (r1_out) put(writer(R1_demux, sample, "R1"), fastq::str_view(blk.r1).substr(r1_begin, route.r1_end - r1_begin));
+      if (clipping) put(writer(R2_demux, sample, "R2"), fastq::str_view(blk.r2).substr(r2_begin, route.r2_end - r2_begin));
+      r1_begin = route.r1_end;
+      r2_begin = route.r2_end;
+    }
+    demux_writer_t::flush(*gPool, demux_cs, full, demux_writer_t::flush_t::chunk);
+    if (demux_open.size() > demux_max_open) {
+      // bounds the memory of many sparse samples
+      demux_writer_t::flush(*gPool, demux_cs, demux_open, demux_writer_t::flush_t::spill);
+      demux_open.clear();
     }
   }
+
+  // compresses the buffered input of all per-sample writers
+  void flush_demux(demux_writer_t::flush_t mode) {
+    auto writers = std::vector<demux_writer_t*>{};
+    for (auto* demux : { &R1_demux, &R2_demux }) {
+      for (auto& [s, writer] : *demux) writers.push_back(writer.get());
+    }
+    demux_writer_t::flush(*gPool, demux_cs, writers, mode);
+    demux_open.clear();
+  }
 };
 
 
+void run_h4(H4& h4) {
+  if (h4.plate.empty()) {
+    h4.run<false>();
+  }
+  else {
+    h4.run<true>();
+  }
+}
+
+
+// estimated peak memory of the pipeline [bytes]
+double pipeline_memory(const json& tuning, const json& metrics) {
+  const double reads = std::max<double>(1, metrics.at("reads").get<double>());
+  const double threads = metrics.at("/pool/threads"_json_pointer).get<double>();
+  double in = 0, out = 0;
+  for (const auto& m : metrics.at("inputs")) in += m.at("bytes").get<double>() / reads;
+  for (const auto& m : metrics.at("outputs")) out += m.at("bytes").get<double>() / reads;
+  const auto& r = tuning.at("reader");
+  const auto& w = tuning.at("writer");
+  const double blk_size = tuning.at("blk_size").get<double>();
+  const double readers = metrics.at("inputs").size() * (r.at("chunks").get<double>() + 2) * r.at("chunk_size").get<double>();
+  const double blocks = 3 * threads * blk_size * (in + out);    // reorder buffer + running jobs
+  const double writers = metrics.at("outputs").size() * (w.at("chunks").get<double>() + 1) * 
+                         std::max(threads * w.at("chunk_size").get<double>(), blk_size * out);
+  return readers + blocks + writers;
+}
+
+
+// runs a sample of the range with different buffer geometries,
+// returns the fastest within the memory budget
+json autotune(const H4& h4) {
+  const auto& J = h4.J;
+  size_t sample = 100000;
+  double max_memory = 4096;   // MB
+  optional_json(sample = J.at("/tuning/autotune_reads"_json_pointer).get<size_t>());
+  if (h4.memory_mb) max_memory = double(h4.memory_mb);
+  optional_json(max_memory = J.at("/tuning/max_memory_mb"_json_pointer).get<double>());
+  sample = std::min(sample, h4.range.second - h4.range.first);
+  const auto root = h4.out_root / ".autotune";
+  
+  auto trial = [&](const json& tuning) {
+    auto Jt = J;
+    Jt["tuning"] = tuning;
+    Jt["range"] = std::to_string(h4.range.first) + ':' + std::to_string(sample);
+    Jt["output"]["root"] = root.string();
+    Jt["checkpoint"] = 0;
+    auto metrics = json{};
+    {
+      auto t = H4{Jt, false};
+      t.stats_only = h4.stats_only;
+      fs::remove_all(t.out_root);
+      fs::create_directories(t.out_root);
+      run_h4(t);
+      metrics = json::parse(std::ifstream(t.out_root / "metrics.json"));
+    }
+    fs::remove_all(root);
+    const double mem = pipeline_memory(tuning, metrics) / (1024 * 1024);
+    const double rps = (mem <= max_memory) ? metrics.at("reads_per_s").get<double>() : 0.0;
+    if (h4.verbose) {
+      std::cerr << "autotune: " << tuning.dump() << "  " << size_t(rps) << " reads/s  ~" << size_t(mem) << " MB\n";
+    }
+    return std::pair{ rps, metrics };
+  };
+
+  // stage bound by queue x: producer or consumer of x blocked for more than 5%
+  auto blocked = [](const json& m, const char* io, const char* wait) {
+    double w = 0;
+    for (const auto& q : m.at(io)) w += q.at("queue").at(wait).get<double>();
+    return w > 0.05 * m.at("elapsed_s").get<double>();
+  };
+
+  auto best = h4.tuning();
+  auto [best_rps, best_metrics] = trial(best);
+  // accepts candidate if faster (gain > 3%) or not slower but smaller (gain > -3%)
+  auto consider = [&](json candidate, double gain) {
+    auto [rps, metrics] = trial(candidate);
+    if (rps > (1.0 + gain) * best_rps) {
+      best = std::move(candidate);
+      best_rps = rps;
+      best_metrics = std::move(metrics);
+      return true;
+    }
+    return false;
+  };
+
+  // block size
+  const auto blk0 = best.at("blk_size").get<size_t>();
+  for (auto blk : { blk0 / 4, blk0 / 2, blk0 * 2, blk0 * 4 }) {
+    if (blk < 1000 || blk > std::max<size_t>(sample / 4, 1000)) continue;
+    auto candidate = best;
+    candidate["blk_size"] = blk;
+    consider(candidate, (blk < best.at("blk_size").get<size_t>()) ? -0.03 : 0.03);
+  }
+  // reader queue depth: starving consumer -> deeper, full queues -> shallower
+  for (bool grow = true; grow;) {
+    auto candidate = best;
+    auto& chunks = candidate["reader"]["chunks"];
+    if (blocked(best_metrics, "inputs", "pop_wait_s") && chunks.get<unsigned>() < 64) {
+      chunks = 2 * chunks.get<unsigned>();
+      grow = consider(candidate, 0.03);
+    }
+    else if (!blocked(best_metrics, "inputs", "pop_wait_s") && chunks.get<unsigned>() > 4) {
+      chunks = chunks.get<unsigned>() / 2;
+      grow = consider(candidate, -0.03);
+    }
+    else grow = false;
+  }
+  // writer queue depth: blocked producer -> deeper, idle queues -> shallower
+  for (bool grow = !best_metrics.at("outputs").empty(); grow;) {
+    auto candidate = best;
+    auto& chunks = candidate["writer"]["chunks"];
+    if (blocked(best_metrics, "outputs", "push_wait_s") && chunks.get<unsigned>() < 64) {
+      chunks = 2 * chunks.get<unsigned>();
+      grow = consider(candidate, 0.03);
+    }
+    else if (!blocked(best_metrics, "outputs", "push_wait_s") && chunks.get<unsigned>() > 4) {
+      chunks = chunks.get<unsigned>() / 2;
+      grow = consider(candidate, -0.03);
+    }
+    else grow = false;
+  }
+  if (best_rps == 0) throw "autotune: no geometry within tuning/max_memory_mb";
+  return best;
+}
+
+
+// decompressed head of file up to the end of record 'records'
+std::shared_ptr<const std::string> preload(const fs::path& path, size_t records) {
+  auto in = fastq::infile_t(path, 1 << 20);
+  auto buf = std::vector<char>(1 << 20);
+  auto data = std::make_shared<std::string>();
+  const size_t max_lines = (records < size_t(-1) / 4) ? 4 * records : size_t(-1);
+  size_t lines = 0;
+  int n = 0;
+  while ((lines < max_lines) && (0 < (n = in.read(buf.data(), static_cast<unsigned>(buf.size()))))) {
+    const char* p = buf.data();
+    const char* end = p + n;
+    while ((p != end) && (lines < max_lines)) {
+      const auto* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      p = nl ? nl + 1 : end;
+      lines += (nl != nullptr);
+    }
+    data->append(buf.data(), static_cast<size_t>(p - buf.data()));
+  }
+  if (n < 0) throw std::runtime_error("error reading " + path.string());
+  return data;
+}
+
+
+// runs the range once per mode and pool size, stages replaced by no-ops.
+// prints one json line per run to stdout, collected in bench.json
+void bench(const H4& h4, const std::vector<std::string>& modes, std::vector<unsigned> threads) {
+  const auto& J = h4.J;
+  if (threads.empty()) threads.push_back(gPool->num_threads());
+  const auto root = h4.out_root / ".bench";
+  auto input = std::array<std::shared_ptr<const std::string>, 5>{};
+  auto results = json::array();
+  for (const auto& mode : modes) {
+    auto b = bench_t::parse(mode);
+    if (h4.streams() && !b.null_writer) throw "--bench: stdout or named pipe outputs require null-writer";
+    if (b.mem_input) {
+      if (!input[R1_]) {
+        // once, the range must fit into memory
+        const std::pair<ReadIdx, const Splitter*> RS[] = { { R1_, &h4.R1 }, { R2_, &h4.R2 }, { R3_, &h4.R3 }, { R4_, &h4.R4 }, { I1_, &h4.I1 } };
+        for (auto [r, R] : RS) {
+          if ((r == I1_) && h4.plate.empty()) continue;
+          input[r] = preload(R->reader().path(), h4.range.second);
+          if (h4.verbose) std::cerr << "bench: preloaded " << (input[r]->size() >> 20) << " MB of " << R->reader().path().filename().string() << '\n';
+        }
+      }
+      b.input = input;
+    }
+    double rps0 = 0;
+    for (auto n : threads) {
+      auto Jt = J;
+      Jt["pool_threads"] = n;
+      Jt["range"] = std::to_string(h4.range.first) + ((h4.range.second == size_t(-1)) ? "" : '-' + std::to_string(h4.range.second));
+      Jt["output"]["root"] = root.string();
+      Jt["checkpoint"] = 0;
+      auto metrics = json{};
+      {
+        auto t = H4{Jt, false, b};
+        t.stats_only = h4.stats_only;
+        fs::remove_all(t.out_root);
+        fs::create_directories(t.out_root);
+        run_h4(t);
+        metrics = json::parse(std::ifstream(t.out_root / "metrics.json"));
+      }
+      fs::remove_all(root);
+      const auto rps = metrics.at("reads_per_s").get<double>();
+      if (rps0 == 0) rps0 = rps;
+      auto R = json{
+        { "mode", mode },
+        { "pool_threads", metrics.at("/pool/threads"_json_pointer) },
+        { "reads", metrics.at("reads") },
+        { "elapsed_s", metrics.at("elapsed_s") },
+        { "reads_per_s", rps },
+        { "speedup", rps / rps0 },    // vs. first pool size
+        { "pool_busy_fraction", metrics.at("/pool/busy_fraction"_json_pointer) },
+        { "stages", metrics.at("stages") }
+      };
+      std::cout << R.dump() << std::endl;
+      results.push_back(std::move(R));
+    }
+  }
+  std::ofstream(h4.out_root / "bench.json") << results.dump(2) << '\n';
+}
+
+
 int main(int argc, const char** argv) {
   try {
     bool force = false;
     bool verbose = false;
     bool dry_run = false;
+    bool stats_only = false;
+    bool resume = false;
+    bool tune = false;
+    std::vector<std::string> bench_modes;
+    std::vector<unsigned> bench_threads;
+    std::optional<size_t> memory_mb;
+    std::pair<size_t, size_t> shard{0, 0};
+    fs::path trace_file;
     std::vector<std::string> replace{};
     std::string json_file;
     int i = 1;
@@ -405,6 +1581,55 @@ int main(int argc, const char** argv) {
       else if (0 == std::strcmp(argv[i], "--dry")) {
         dry_run = true;
       }
+      else if (0 == std::strcmp(argv[i], "--stats")) {
+        stats_only = true;
+      }
+      else if (0 == std::strcmp(argv[i], "--resume")) {
+        resume = true;
+      }
+      else if (0 == std::strcmp(argv[i], "--autotune")) {
+        tune = true;
+      }
+      else if (0 == std::strcmp(argv[i], "--bench")) {
+        if ((i + 1) >= argc) throw "--bench: missing argument";
+        for (auto str = std::string_view(argv[++i]); !str.empty();) {
+          const auto sep = str.find(',');
+          bench_modes.emplace_back(str.substr(0, sep));
+          str.remove_prefix((sep == str.npos) ? str.size() : sep + 1);
+        }
+      }
+      else if (0 == std::strcmp(argv[i], "--bench-threads")) {
+        if ((i + 1) >= argc) throw "--bench-threads: missing argument";
+        for (auto str = std::string_view(argv[++i]); !str.empty();) {
+          unsigned n = 0;
+          auto [p, ec] = std::from_chars(str.begin(), str.end(), n);
+          if ((ec != std::errc{}) || (n == 0) || ((p != str.end()) && (*p != ','))) throw "--bench-threads: can't parse argument";
+          bench_threads.push_back(n);
+          str.remove_prefix(p - str.begin() + (p != str.end()));
+        }
+      }
+      else if (0 == std::strcmp(argv[i], "--trace")) {
+        if ((i + 1) >= argc) throw "--trace: missing argument";
+        trace_file = argv[++i];
+#ifdef HAHI_TRACE
+        hahi::trace::enable();
+        HAHI_TRACE_THREAD("main");
+#else
+        throw "--trace: not supported, build with -DHAHI_TRACE=ON";
+#endif
+      }
+      else if (0 == std::strcmp(argv[i], "--mem")) {
+        if ((i + 1) >= argc) throw "--mem: missing argument";
+        const auto str = std::string_view(argv[++i]);
+        size_t mb = 0;
+        auto [p, ec] = std::from_chars(str.begin(), str.end(), mb);
+        if ((ec != std::errc{}) || (p != str.end())) throw "--mem: can't parse argument";
+        memory_mb = mb;
+      }
+      else if (0 == std::strcmp(argv[i], "--shard")) {
+        if ((i + 1) >= argc) throw "--shard: missing argument";
+        shard = parse_shard(argv[++i]);
+      }
       else if (0 == std::strcmp(argv[i], "--replace")) {
         if ((i + 1) > argc) throw "--replace: missing arguments";
         replace.emplace_back(argv[++i]);
@@ -429,27 +1654,56 @@ int main(int argc, const char** argv) {
         J[json::json_pointer(e.key())] = e.value();
       }
     }
-    auto h4 = H4{J, verbose};
+    if (memory_mb) J["tuning"]["memory_mb"] = *memory_mb;
+    auto make_h4 = [&]() {
+      auto h4 = std::make_unique<H4>(J, verbose);
+      if (shard.second) h4->shard(shard.first, shard.second);
+      h4->stats_only = stats_only;
+      return h4;
+    };
+    auto h4 = make_h4();
     if (dry_run) {
-      h4.dry_run();
+      h4->dry_run();
       return 0;
     }
-    if (!(h4.clipping || h4.r1_out)) {
-      throw ("Neigther R1 nor R2 output specified\n. Bailing out.");
+    if (!(h4->clipping || h4->r1_out || h4->stats_only || !h4->ubam.empty())) {
+      throw ("Neigther R1, R2 nor uBAM output specified\n. Bailing out.");
+    }
+    if (resume) {
+      if (stats_only) throw "--resume: nothing to resume in stats-only run";
+      h4->resume();
     }
-    if (fs::exists(h4.out_root)) { 
+    else if (fs::exists(h4->out_root)) { 
       if (!force) {
         throw "Output directory already exists. Consider '-f'";
       }
-      fs::remove_all(h4.out_root);
+      fs::remove_all(h4->out_root);
     }
-    fs::create_directories(h4.out_root);
-    if (h4.plate.empty()) {
-      h4.run<false>();
+    fs::create_directories(h4->out_root);
+    if (!bench_modes.empty()) {
+      if (resume) throw "--bench: can't be combined with --resume";
+      bench(*h4, bench_modes, bench_threads);
+      return 0;
     }
-    else {
-      h4.run<true>();
+    if (tune) {
+      if (h4->streams()) throw "--autotune: not supported with stdout or named pipe outputs";
+      // tuned geometry goes into the dumped H4.json
+      J["tuning"].update(autotune(*h4));
+      const auto range = h4->range;    // resumed
+      const auto resume_files = h4->resume_files;
+      h4.reset();
+      h4 = make_h4();
+      h4->range = range;
+      h4->resume_files = resume_files;
     }
+#ifdef HAHI_TRACE
+    // dump trace even if the run fails
+    struct trace_guard { 
+      const fs::path& file; 
+      ~trace_guard() { if (!file.empty()) { auto os = std::ofstream(file); hahi::trace::dump(os); } }
+    } _{trace_file};
+#endif
+    run_h4(*h4);
     return 0;
   }
   catch (std::exception& err) {
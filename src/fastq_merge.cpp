@@ -0,0 +1,262 @@
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <map>
+#include <set>
+#include <nlohmann/json.hpp>
+#include <fastq/writer.hpp>
+
+
+constexpr char usage_msg[] = R"(Usage: fastq_merge [OPTIONS] SHARD_DIR...
+Merges the output directories of 'fastq_h4 --shard i/N' runs.
+
+gzip members are concatenated byte-for-byte, without recompression.
+The shards (manifest.json) must cover a contiguous range of reads.
+
+  -f: force overwrite of output directory.
+  -o <DIR>: output directory (required).
+  -v, --verbose: verbose output.
+  --verify: decompress shard outputs and check size, crc32 and read count
+    against the manifests.
+)";
+
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+
+namespace fastq {
+
+  void to_json(json& j, const stream_pos_t& pos) {
+    j = json{ { "size", pos.file_bytes }, { "bytes", pos.bytes }, { "crc32", pos.crc } };
+  }
+
+  void from_json(const json& j, stream_pos_t& pos) {
+    j.at("size").get_to(pos.file_bytes);
+    j.at("bytes").get_to(pos.bytes);
+    j.at("crc32").get_to(pos.crc);
+  }
+
+}
+
+
+struct shard_t {
+  fs::path dir;
+  size_t index = 0;
+  size_t shards = 0;
+  std::pair<size_t, size_t> range;
+  std::array<std::string, 2> output;    // R1, R2 file names
+  bool interleaved = false;             // R1 holds R1 and R2 records
+  std::map<std::string, fastq::stream_pos_t> files;
+};
+
+
+shard_t read_manifest(const fs::path& dir) {
+  auto is = std::ifstream(dir / "manifest.json");
+  if (!is) throw std::runtime_error("no manifest.json in " + dir.string() + ", incomplete shard?");
+  const auto M = json::parse(is);
+  auto shard = shard_t{ .dir = dir, .index = 0, .shards = 0, .range = {}, .output = {}, .interleaved = false, .files = {} };
+  shard.index = M.at("shard").at(0).get<size_t>();
+  shard.shards = M.at("shard").at(1).get<size_t>();
+  shard.range = { M.at("range").at(0).get<size_t>(), M.at("range").at(1).get<size_t>() };
+  shard.output = { M.at("output").at("R1").get<std::string>(), M.at("output").at("R2").get<std::string>() };
+  shard.interleaved = M.value("interleaved", false);
+  shard.files = M.at("files").get<std::map<std::string, fastq::stream_pos_t>>();
+  return shard;
+}
+
+
+// decompresses file, returns crc32, size and number of lines
+std::tuple<uint32_t, size_t, size_t> scan_gz(const fs::path& path) {
+  auto in = fastq::infile_t(path, 1 << 20);
+  auto buf = std::vector<char>(1 << 20);
+  uint32_t crc = zng_crc32(0L, nullptr, 0);
+  size_t bytes = 0, lines = 0;
+  int n = 0;
+  while (0 < (n = in.read(buf.data(), static_cast<unsigned>(buf.size())))) {
+    crc = zng_crc32(crc, (const unsigned char*)buf.data(), n);
+    bytes += n;
+    lines += std::count(buf.data(), buf.data() + n, '\n');
+  }
+  if (n < 0) throw std::runtime_error("error reading " + path.string());
+  return { crc, bytes, lines };
+}
+
+
+void verify(const shard_t& shard, bool verbose) {
+  std::array<size_t, 2> reads = { 0, 0 };   // R1, R2
+  const size_t record_lines = shard.interleaved ? 8 : 4;    // per read
+  for (const auto& [file, pos] : shard.files) {
+    const auto path = shard.dir / file;
+    const auto [crc, bytes, lines] = scan_gz(path);
+    if ((crc != pos.crc) || (bytes != pos.bytes)) throw std::runtime_error("crc32 mismatch: " + path.string());
+    if (lines % record_lines) throw std::runtime_error("truncated fastq record: " + path.string());
+    for (size_t r = 0; r < 2; ++r) {
+      // demux: <sample>_<output>
+      const auto& out = shard.output[r];
+      if (!out.empty() && ((file == out) || file.ends_with('_' + out))) reads[r] += lines / record_lines;
+    }
+    if (verbose) std::cerr << path.string() << ": " << lines / record_lines << " reads ok\n";
+  }
+  for (size_t r = 0; r < 2; ++r) {
+    if (!shard.output[r].empty() && (reads[r] != shard.range.second - shard.range.first)) {
+      throw std::runtime_error("read count mismatch: " + shard.dir.string());
+    }
+  }
+}
+
+
+// sums tab-separated tables (header, key, counts...)
+// sorted: rows sorted by key, otherwise rows in order of appearance
+void merge_table(const std::vector<shard_t>& shards, const char* name, const fs::path& out_root, bool sorted) {
+  std::string header;
+  std::vector<std::string> keys;
+  std::map<std::string, std::vector<size_t>> rows;
+  for (const auto& shard : shards) {
+    auto is = std::ifstream(shard.dir / name);
+    if (!is) return;    // e.g. stats-only run
+    std::string line;
+    std::getline(is, header);
+    while (std::getline(is, line)) {
+      const auto tab = line.find('\t');
+      auto key = line.substr(0, tab);
+      auto [it, inserted] = rows.try_emplace(key);
+      if (inserted) keys.push_back(key);
+      for (size_t col = 0, pos = tab; pos != std::string::npos; ++col) {
+        const auto val = std::stoull(line.substr(pos + 1));
+        if (it->second.size() <= col) it->second.resize(col + 1);
+        it->second[col] += val;
+        pos = line.find('\t', pos + 1);
+      }
+    }
+  }
+  if (sorted) std::sort(keys.begin(), keys.end());
+  auto os = std::ofstream(out_root / name);
+  os << header << '\n';
+  for (const auto& key : keys) {
+    os << key;
+    for (auto val : rows[key]) os << '\t' << val;
+    os << '\n';
+  }
+}
+
+
+int main(int argc, const char* argv[]) {
+  try {
+    bool force = false;
+    bool verbose = false;
+    bool do_verify = false;
+    fs::path out_root;
+    std::vector<fs::path> dirs;
+    int i = 1;
+    while (i < argc) {
+      if (0 == std::strcmp(argv[i], "-h") * std::strcmp(argv[i], "--help")) {
+        throw usage_msg;
+      }
+      else if (0 == std::strcmp(argv[i], "-f")) {
+        force = true;
+      }
+      else if (0 == std::strcmp(argv[i], "-v") * std::strcmp(argv[i], "--verbose")) {
+        verbose = true;
+      }
+      else if (0 == std::strcmp(argv[i], "--verify")) {
+        do_verify = true;
+      }
+      else if (0 == std::strcmp(argv[i], "-o")) {
+        if ((i + 1) < argc) out_root = argv[++i];
+      }
+      else if (fs::is_directory(argv[i])) {
+        dirs.emplace_back(argv[i]);
+      }
+      else {
+        std::cerr << "invalid argument '" << argv[i] << "'\n";
+        throw usage_msg;
+      }
+      ++i;
+    }
+    if (out_root.empty() || dirs.empty()) throw usage_msg;
+
+    // consistency checks
+    auto shards = std::vector<shard_t>{};
+    for (const auto& dir : dirs) shards.push_back(read_manifest(dir));
+    std::sort(shards.begin(), shards.end(), [](const auto& a, const auto& b) { return a.range.first < b.range.first; });
+    auto indices = std::set<size_t>{};
+    for (size_t s = 0; s < shards.size(); ++s) {
+      if (shards[s].shards != shards[0].shards) throw "shards from different splits";
+      if ((shards[s].output != shards[0].output) || (shards[s].interleaved != shards[0].interleaved)) throw "shards with different outputs";
+      if (!indices.insert(shards[s].index).second) throw "duplicated shard";
+      if (s && (shards[s].range.first != shards[s - 1].range.second)) {
+        throw std::runtime_error("gap or overlap between shards " + shards[s - 1].dir.string() + " and " + shards[s].dir.string());
+      }
+    }
+    if (indices.size() != shards[0].shards) {
+      std::cerr << "warning: " << indices.size() << " of " << shards[0].shards << " shards\n";
+    }
+    auto files = std::set<std::string>{};
+    for (const auto& shard : shards) {
+      for (const auto& [file, pos] : shard.files) {
+        if (file.ends_with(".bam")) {
+          // a BAM header per shard, not concatenable byte-for-byte
+          throw std::runtime_error("can't merge uBAM " + file + ", consider 'samtools cat'");
+        }
+        if (fs::file_size(shard.dir / file) != pos.file_bytes) {
+          throw std::runtime_error("size mismatch: " + (shard.dir / file).string());
+        }
+        files.insert(file);
+      }
+    }
+    if (do_verify) {
+      for (const auto& shard : shards) verify(shard, verbose);
+    }
+
+    if (fs::exists(out_root)) {
+      if (!force) throw "Output directory already exists. Consider '-f'";
+      fs::remove_all(out_root);
+    }
+    fs::create_directories(out_root);
+
+    // byte-for-byte concatenation of gzip members
+    auto M = json{
+      { "shard", { 0, 1 } },
+      { "range", { shards.front().range.first, shards.back().range.second } },
+      { "output", { { "R1", shards[0].output[0] }, { "R2", shards[0].output[1] } } },
+      { "interleaved", shards[0].interleaved },
+      { "files", json::object() }
+    };
+    for (const auto& file : files) {
+      auto os = std::ofstream(out_root / file, std::ios::binary);
+      auto pos = fastq::stream_pos_t{ 0, 0, zng_crc32(0L, nullptr, 0) };
+      for (const auto& shard : shards) {
+        auto it = shard.files.find(file);
+        if (it == shard.files.end()) continue;
+        auto is = std::ifstream(shard.dir / file, std::ios::binary);
+        os << is.rdbuf();
+        pos.crc = zng_crc32_combine(pos.crc, it->second.crc, it->second.bytes);
+        pos.bytes += it->second.bytes;
+        pos.file_bytes += it->second.file_bytes;
+      }
+      if (!os.flush()) throw std::runtime_error("failed to write " + (out_root / file).string());
+      M["files"][file] = pos;
+      if (verbose) std::cerr << file << ": " << pos.file_bytes << " bytes\n";
+    }
+    merge_table(shards, "clearBC.log", out_root, true);
+    merge_table(shards, "unclearBC.log", out_root, true);
+    merge_table(shards, "edHist.log", out_root, false);
+    std::ofstream(out_root / "manifest.json") << M.dump(2);
+    return 0;
+  }
+  catch (std::exception& err) {
+    std::cerr << err.what() << std::endl;
+  }
+  catch (const char* err) {
+    std::cerr << err << std::endl;
+  }
+  catch (...) {
+    std::cerr << "unknown exception" << std::endl;
+  }
+  return 1;
+}
@@ -3,6 +3,7 @@
 #include <charconv>
 #include <array>
 #include <memory>
+#include <optional>
 #include <chrono>
 #include <fastq/reader.hpp>
 #include <fastq/splitter.hpp>
@@ -13,9 +14,13 @@ constexpr char usage_msg[] = R"(Usage: fastq_paste [OPTIONS] [FILE] ...
 paste line rangess from fastq[.gz] files.
 
   -f: force overwrite of output file.
+  --bgzf: BGZF compressed output (blocked gzip, as bgzip), same as -c bgzf.
+  -c <codec>: output codec <gzip|bgzf|zstd>[:<level>|:<min>-<max>][:<deflate strategy>] or none
+    Ex: -c gzip:1; -c zstd:19; -c gzip:1-9 (adaptive level).
+    Default: by -o, '-' or named pipe: none, .zst: zstd, gzip otherwise.
   -m <mssk>: only output unmasked lines (max. 64Bit)
     Ex: -m 0010, outputs 2nd line of every 4-line block.
-  -o <FILE>: compressed output file
+  -o <FILE>: output file, '-': standard output
     If not given, writes to standard output.
   -r <line range>: only output lines in given range.
     Ex: -r 0-10; -r 10:3
@@ -73,6 +78,10 @@ public:
       tot_bytes_ += str.length();
     }
   }
+  void submit(std::string&& buf) {
+    put(buf);
+  }
+  unsigned tot_chunk_size() const noexcept { return 1024 * 1024; }
   auto tot_bytes() const { return tot_bytes_; }
 };
 
@@ -95,23 +104,31 @@ void paste(std::vector<fastq::line_splitter<>>& splitter,
   for (size_t i = 0; !any_eof() && (i < range.first); ++i) {
     read_all();
   }
+  // render into whole blocks, handed over to the writer
+  auto blk = std::string{};
+  blk.reserve(writer->tot_chunk_size());
   auto m = mask;
   for (size_t i = range.first; !any_eof() && (i < range.second); ++i) {
     read_all();
     if (m.first & 1) {
       ++lines_out;
-      writer->put(lines[0]);
+      if (blk.size() >= writer->tot_chunk_size()) {
+        writer->submit(std::move(blk));
+        blk = std::string{};
+        blk.reserve(writer->tot_chunk_size());
+      }
+      blk.append(lines[0]);
       for (size_t i = 1; i < lines.size(); ++i) {       
-        writer->put(delim);
-        writer->put(lines[i]);
+        blk.append(delim).append(lines[i]);
       }
-      writer->put("\n");
+      blk.push_back('\n');
     }
     m.first >>= 1;
     if (--m.second == 0) {
       m = mask;
     }
   }
+  writer->submit(std::move(blk));
   for (const auto& s : splitter) { bytes_in += s.tot_bytes(); };
   bytes_out += writer->tot_bytes();
 }
@@ -127,6 +144,8 @@ int main(int argc, const char* argv[]) {
     std::string delim{};
     std::vector<fastq::line_splitter<>> splitter;
     std::filesystem::path output;
+    auto geo = fastq::writer_t<>::geometry_t{};
+    std::optional<fastq::codec_t> codec;
     int i = 1;
     while (i < argc) {
       if (0 == std::strcmp(argv[i], "-h") * std::strcmp(argv[i], "--help")) {
@@ -138,6 +157,12 @@ int main(int argc, const char* argv[]) {
       else if (0 == std::strcmp(argv[i], "-v")) {
         verbose = true;
       }
+      else if (0 == std::strcmp(argv[i], "--bgzf")) {
+        codec = fastq::codec_t{ fastq::codec_t::bgzf };
+      }
+      else if (0 == std::strcmp(argv[i], "-c")) {
+        codec = fastq::codec_t::parse((++i < argc) ? argv[i] : "");
+      }
       else if (0 == std::strcmp(argv[i], "-d")) {
         if ((i + 1) < argc) {
           delim = argv[++i];
@@ -166,12 +191,15 @@ int main(int argc, const char* argv[]) {
     if (std::filesystem::exists(output) && !force) {
       throw "output file exists, consider -f";
     }
+    geo.codec = codec.value_or(fastq::codec_t::from_path(output));
     auto t0 = std::chrono::high_resolution_clock::now();
     if (!splitter.empty()) {
       if (!output.empty()) {
         gPool.reset( new hahi::pool_t{} );
-        auto writer = std::make_unique<fastq::writer_t<>>(output, gPool);
+        auto writer = std::make_unique<fastq::writer_t<>>(output, gPool, unsigned(-1), fastq::stream_pos_t{}, geo);
         paste(splitter, writer.get(), range, mask, delim);
+        writer->close(true);
+        if (writer->failed()) throw "failed to write output file";
       }
       else {
         auto writer = std::make_unique<cout_writer>();
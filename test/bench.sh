@@ -18,14 +18,8 @@ time fastq_h4 src/H4.json -f --replace '{"/range": "0-100000000"}'
 echo && echo 1.000.000.000 sequences
 time fastq_h4 src/H4.json -f --replace '{"/range": "0-1000000000"}'
 
-echo && echo fastq_ha scaling with pool threads, 10.000.000 sequences
-echo && echo pool_threads 4
-time fastq_h4 src/H4.json -f --replace '{"/range": "0-10000000"}' --replace '{"/pool_threads": 4}'
-echo && echo pool_threads 8
-time fastq_h4 src/H4.json -f --replace '{"/range": "0-10000000"}' --replace '{"/pool_threads": 8}'
-echo && echo pool_threads 16
-time fastq_h4 src/H4.json -f --replace '{"/range": "0-10000000"}' --replace '{"/pool_threads": 16}'
-echo && echo pool_threads 24
-time fastq_h4 src/H4.json -f --replace '{"/range": "0-10000000"}' --replace '{"/pool_threads": 24}'
-echo && echo pool_threads 32
-time fastq_h4 src/H4.json -f --replace '{"/range": "0-10000000"}' --replace '{"/pool_threads": 32}'
+echo && echo fastq_h4 stages and scaling with pool threads, 2.000.000 sequences
+# one json line per mode and pool size, see README (--bench)
+fastq_h4 src/H4.json -f --replace '{"/range": "0-2000000"}' \
+  --bench full,null-writer,mem-input+null-writer,mem-input+identity-match+null-writer \
+  --bench-threads 4,8,16,24,32 | tee bench.jsonl
@@ -0,0 +1,29 @@
+#!/bin/bash
+
+set -e # exit on first error
+
+Red='\033[0;31m'
+Green='\033[0;32m'
+NOCOLOR='\033[0m'
+
+export PATH=$PATH:~/haplotag/bin
+
+out=~/haplotag/test/shards
+
+# two interleaved shards, merged and verified against their manifests
+for i in 0 1; do
+    fastq_h4 ~/haplotag/test/test_H4.json -f --shard $i/2 \
+        --replace "{\"/range\": \"0-10000\", \"/output/root\": \"${out}\", \"/output/interleaved\": true}" > /dev/null
+done
+if fastq_merge -f --verify -o ${out}/merged ${out}/shard_0 ${out}/shard_1 \
+   && [[ $(fastq_cat ${out}/merged/R1.fastq.gz | wc -l) -eq 80000 ]]; then
+    echo -e "${Green}test_shard passed!${NOCOLOR}"
+else
+    echo -e "${Red}test_shard failed!${NOCOLOR}"
+    echo Run the test with the '--keep' option for inspection.
+fi
+
+#clean up
+if [ "$1" != "--keep" ]; then
+    rm -rf ${out}
+fi